@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Times cs_akick's expiry queue: pushes 1M expirations with random deadlines,
+ * cancels a random tenth of them as AKICK DEL would, then pops the rest in
+ * order, checking that they come out sorted.
+ */
+
+// the queue functions are static, so take the module as a whole
+#include "../cs_akick.c"
+#include "bench.h"
+
+#define BENCH_EXPIRATIONS 1000000U
+#define BENCH_CANCELLED   (BENCH_EXPIRATIONS / 10)
+#define BENCH_HORIZON     (86400 * 365)
+
+int main(void)
+{
+	akick_timeout_t **timeouts;
+	akick_timeout_t *timeout;
+	time_t last = 0;
+	unsigned long popped = 0;
+	double start;
+	size_t i;
+
+	bench_init();
+
+	akick_timeout_heap = mowgli_heap_create(sizeof(akick_timeout_t), 512, BH_NOW);
+	timeouts = smalloc(BENCH_EXPIRATIONS * sizeof *timeouts);
+
+	for (i = 0; i < BENCH_EXPIRATIONS; i++)
+	{
+		timeouts[i] = mowgli_heap_alloc(akick_timeout_heap);
+		timeouts[i]->expiration = 1 + bench_rand() % BENCH_HORIZON;
+	}
+
+	start = bench_now();
+	for (i = 0; i < BENCH_EXPIRATIONS; i++)
+		akick_queue_push(timeouts[i]);
+	bench_report("push, random deadlines", BENCH_EXPIRATIONS, bench_now() - start);
+
+	// pick the ones to cancel up front so only the removals are timed
+	for (i = 0; i < BENCH_CANCELLED; i++)
+	{
+		size_t j = i + bench_rand() % (BENCH_EXPIRATIONS - i);
+
+		timeout = timeouts[i];
+		timeouts[i] = timeouts[j];
+		timeouts[j] = timeout;
+	}
+
+	start = bench_now();
+	for (i = 0; i < BENCH_CANCELLED; i++)
+		akick_queue_remove(timeouts[i]);
+	bench_report("remove from the middle", BENCH_CANCELLED, bench_now() - start);
+
+	start = bench_now();
+	while (akick_queue.count > 0)
+	{
+		timeout = akick_queue.items[0];
+
+		if (timeout->expiration < last)
+		{
+			fprintf(stderr, "expiration %ld came out after %ld\n", (long)timeout->expiration, (long)last);
+			return 1;
+		}
+
+		last = timeout->expiration;
+		akick_queue_remove(timeout);
+		popped++;
+	}
+	bench_report("pop in order", popped, bench_now() - start);
+
+	if (popped != BENCH_EXPIRATIONS - BENCH_CANCELLED)
+	{
+		fprintf(stderr, "popped %lu expirations, expected %u\n", popped, BENCH_EXPIRATIONS - BENCH_CANCELLED);
+		return 1;
+	}
+
+	return 0;
+}
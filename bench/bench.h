@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Shared helpers for the standalone benchmarks in this directory. They are
+ * built against the same atheme tree as the modules (see "make bench") and
+ * are not installed.
+ */
+
+#ifndef ATHEME_FREENODE_BENCH_H
+#define ATHEME_FREENODE_BENCH_H
+
+#include <atheme.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// milliseconds on the monotonic clock
+static inline double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// xorshift64*; fixed seed so runs are comparable
+static uint64_t bench_rng = UINT64_C(0x9E3779B97F4A7C15);
+
+static inline uint64_t bench_rand(void)
+{
+	bench_rng ^= bench_rng >> 12;
+	bench_rng ^= bench_rng << 25;
+	bench_rng ^= bench_rng >> 27;
+	return bench_rng * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static inline void bench_report(const char * const what, const unsigned long ops, const double ms)
+{
+	printf("%-44s %9lu ops %10.2f ms %9.1f ns/op\n", what, ops, ms, ops ? ms * 1e6 / ops : 0.0);
+}
+
+// Some of the code under test reads CURRTIME, which needs the event loop
+static inline void bench_init(void)
+{
+	base_eventloop = mowgli_eventloop_create();
+	strshare_init();
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Times channame_get_project() against the lookup it replaced, which copied
+ * the name to the heap and looked up every shorter prefix after rescanning it
+ * for the last separator, on a registry of 50k channel namespaces.
+ */
+
+#include "registry.h"
+
+#define BENCH_NAMESPACES 50000U
+#define BENCH_LOOKUPS    1000000U
+
+// The old lookup, kept here as the baseline
+static bool old_trim_last_component(char *chan)
+{
+	for (size_t i = strlen(chan) - 1; i > 0; i--)
+	{
+		if (strchr(projectsvs.config.namespace_separators, chan[i]))
+		{
+			chan[i] = '\0';
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static struct projectns *old_channame_get_project(const char * const name, char **out_namespace)
+{
+	char *buf = sstrdup(name);
+	struct project_namespace *ns;
+	struct projectns *p = NULL;
+
+	do {
+		if ((ns = channelns_find(buf)))
+		{
+			p = ns->project;
+			break;
+		}
+	} while (old_trim_last_component(buf));
+
+	if (out_namespace && p)
+		*out_namespace = buf;
+	else
+		free(buf);
+
+	return p;
+}
+
+int main(void)
+{
+	char name[CHANNELLEN];
+	char **queries;
+	unsigned long found = 0;
+	double start;
+
+	bench_registry_init();
+
+	for (unsigned int i = 0; i < BENCH_NAMESPACES; i++)
+	{
+		snprintf(name, sizeof name, "project%u", i);
+		struct projectns *p = project_new(name);
+
+		snprintf(name, sizeof name, "#ns%u", i);
+		channelns_add(p, name);
+
+		// some projects also own a deeper namespace of their own
+		if (i % 10 == 0)
+		{
+			snprintf(name, sizeof name, "#ns%u-dev", i);
+			channelns_add(p, name);
+		}
+	}
+
+	/* A mix of what registration checks and INFO see: namespaces themselves,
+	 * channels a few components below one, and channels under no namespace.
+	 */
+	queries = smalloc(BENCH_LOOKUPS * sizeof *queries);
+
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		const unsigned int ns = bench_rand() % BENCH_NAMESPACES;
+
+		switch (i % 4)
+		{
+			case 0:  snprintf(name, sizeof name, "#ns%u", ns); break;
+			case 1:  snprintf(name, sizeof name, "#ns%u-dev-offtopic", ns); break;
+			case 2:  snprintf(name, sizeof name, "#ns%u-community-social-games", ns); break;
+			default: snprintf(name, sizeof name, "#unregistered%u-meta-chat", ns); break;
+		}
+
+		queries[i] = sstrdup(name);
+	}
+
+	// both have to agree before their times mean anything
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		char *old_ns = NULL;
+		struct projectns *old_p = old_channame_get_project(queries[i], &old_ns);
+		struct projectns *p = channame_get_project(queries[i], name, sizeof name);
+
+		if (p != old_p || (p && strcmp(name, old_ns) != 0))
+		{
+			fprintf(stderr, "%s: lookups disagree (%s vs %s)\n", queries[i],
+			        p ? name : "none", old_p ? old_ns : "none");
+			return 1;
+		}
+
+		free(old_ns);
+	}
+
+	start = bench_now();
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		char *old_ns = NULL;
+
+		if (old_channame_get_project(queries[i], &old_ns))
+			found++;
+		free(old_ns);
+	}
+	bench_report("old: sstrdup() and trim per prefix", BENCH_LOOKUPS, bench_now() - start);
+
+	found = 0;
+	start = bench_now();
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		if (channame_get_project(queries[i], name, sizeof name))
+			found++;
+	}
+	bench_report("channame_get_project()", BENCH_LOOKUPS, bench_now() - start);
+
+	printf("%u namespaces, %lu of %u lookups found a project\n", mowgli_patricia_size(projectsvs.channel_namespaces),
+	       found, BENCH_LOOKUPS);
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Checks glob_match() against match() on random patterns and names, then
+ * times both on patterns like those LIST and the namespace exempt check use.
+ * Run this after any change to glob.c; it exits nonzero on the first
+ * disagreement.
+ */
+
+#include "registry.h"
+
+#define CHECK_PAIRS   2000000U
+#define BENCH_NAMES   100000U
+#define BENCH_REPEAT  10U
+
+/* A small alphabet makes repeats and near misses likely. It covers both
+ * cases, the characters rfc1459 folds together, and the separators used in
+ * channel names.
+ */
+static const char name_chars[]    = "aAbB[{]}-#";
+static const char pattern_chars[] = "aAbB[{]}-#??**";
+
+static void random_string(char * const buf, const char * const chars, const size_t nchars, const size_t maxlen)
+{
+	const size_t len = bench_rand() % (maxlen + 1);
+
+	for (size_t i = 0; i < len; i++)
+		buf[i] = chars[bench_rand() % nchars];
+	buf[len] = '\0';
+}
+
+static bool check(const char * const pattern, const char * const name)
+{
+	struct compiled_glob *g = glob_compile(pattern);
+	const bool got = glob_match(g, name), want = !match(pattern, name);
+
+	glob_free(g);
+
+	if (got != want)
+		fprintf(stderr, "pattern \"%s\", name \"%s\": glob_match() says %d, match() says %d\n", pattern, name, got, want);
+
+	return got == want;
+}
+
+static const char * const fixed_cases[][2] = {
+	{ "", "" }, { "", "a" }, { "*", "" }, { "**", "a" }, { "?", "" }, { "a*a", "a" },
+	{ "*a*a*", "aa" }, { "*ab", "aab" }, { "a*b*c", "abbc" }, { "#*-dev", "#FOO-DEV" },
+	{ "[x]*", "{X}yz" }, { "*?", "" }, { "?*?", "ab" },
+};
+
+static const char * const bench_patterns[] = {
+	"*",
+	"#ubuntu*",
+	"*-dev",
+	"#*-offtopic",
+	"#gentoo-*-dev",
+	"#?????",
+};
+
+int main(void)
+{
+	char pattern[32], name[32];
+	char **names;
+	unsigned int failures = 0;
+
+	bench_init();
+
+	for (size_t i = 0; i < sizeof fixed_cases / sizeof fixed_cases[0]; i++)
+		if (!check(fixed_cases[i][0], fixed_cases[i][1]))
+			failures++;
+
+	for (unsigned int i = 0; i < CHECK_PAIRS && failures < 10; i++)
+	{
+		random_string(pattern, pattern_chars, sizeof pattern_chars - 1, 8);
+		random_string(name, name_chars, sizeof name_chars - 1, 12);
+
+		if (!check(pattern, name))
+			failures++;
+	}
+
+	if (failures)
+		return 1;
+
+	printf("glob_match() agrees with match() on %u random pairs\n", CHECK_PAIRS);
+
+	static const char * const words[] = { "ubuntu", "gentoo", "debian", "python", "wiki", "kde" };
+	static const char * const suffixes[] = { "", "-dev", "-offtopic", "-social", "-meta-dev" };
+
+	names = smalloc(BENCH_NAMES * sizeof *names);
+	for (unsigned int i = 0; i < BENCH_NAMES; i++)
+	{
+		snprintf(name, sizeof name, "#%s%u%s", words[bench_rand() % 6], (unsigned int)(bench_rand() % 1000),
+		         suffixes[bench_rand() % 5]);
+		names[i] = sstrdup(name);
+	}
+
+	for (size_t p = 0; p < sizeof bench_patterns / sizeof bench_patterns[0]; p++)
+	{
+		const char * const pat = bench_patterns[p];
+		unsigned int hits_match = 0, hits_glob = 0;
+		char label[BUFSIZE];
+		double start;
+
+		start = bench_now();
+		for (unsigned int r = 0; r < BENCH_REPEAT; r++)
+			for (unsigned int i = 0; i < BENCH_NAMES; i++)
+				hits_match += !match(pat, names[i]);
+		snprintf(label, sizeof label, "%s: match()", pat);
+		bench_report(label, (unsigned long)BENCH_NAMES * BENCH_REPEAT, bench_now() - start);
+
+		// compiled once per command, so once per pass here
+		start = bench_now();
+		for (unsigned int r = 0; r < BENCH_REPEAT; r++)
+		{
+			struct compiled_glob *g = glob_compile(pat);
+
+			for (unsigned int i = 0; i < BENCH_NAMES; i++)
+				hits_glob += glob_match(g, names[i]);
+			glob_free(g);
+		}
+		snprintf(label, sizeof label, "%s: glob_compile() + glob_match()", pat);
+		bench_report(label, (unsigned long)BENCH_NAMES * BENCH_REPEAT, bench_now() - start);
+
+		if (hits_match != hits_glob)
+		{
+			fprintf(stderr, "%s: match() found %u, glob_match() %u\n", pat, hits_match, hits_glob);
+			return 1;
+		}
+	}
+
+	return 0;
+}
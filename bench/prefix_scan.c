@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Times LISTCHANNEL-style scans on a registry of 100k channel namespaces: the
+ * old full walk of the namespace tree calling match() on every key, against
+ * the key index walk over just the pattern's literal prefix. Both use match()
+ * so only the scans themselves differ.
+ */
+
+#include "registry.h"
+
+#define BENCH_NAMESPACES 100000U
+#define BENCH_REPEAT     20U
+
+static const char * const words[] = {
+	"ubuntu", "gentoo", "debian", "fedora", "python", "haskell", "rust", "wiki",
+	"kde", "gnome", "arch", "freebsd", "openbsd", "mozilla", "apache", "libre",
+};
+
+#define NWORDS (sizeof words / sizeof words[0])
+
+static const char * const patterns[] = {
+	"#ubuntu-*",
+	"#gentoo12*",
+	"#python4242-dev",
+	"#wiki*-offtopic",
+	"*-dev",
+};
+
+#define NPATTERNS (sizeof patterns / sizeof patterns[0])
+
+struct scan_state {
+	const char *pattern;
+	unsigned int matches;
+};
+
+static int scan_cb(const char *key, void *data, void *privdata)
+{
+	struct scan_state * const st = privdata;
+
+	if (!match(st->pattern, key))
+		st->matches++;
+
+	return 0;
+}
+
+int main(void)
+{
+	char name[CHANNELLEN];
+
+	bench_registry_init();
+
+	key_indexes_defer();
+	for (unsigned int i = 0; i < BENCH_NAMESPACES / 2; i++)
+	{
+		snprintf(name, sizeof name, "project%u", i);
+		struct projectns *p = project_new(name);
+
+		snprintf(name, sizeof name, "#%s%u", words[i % NWORDS], i);
+		channelns_add(p, name);
+		snprintf(name, sizeof name, "#%s-%u", words[i % NWORDS], i);
+		channelns_add(p, name);
+	}
+	key_indexes_settle();
+
+	printf("%u channel namespaces, each pattern scanned %u times:\n", mowgli_patricia_size(projectsvs.channel_namespaces), BENCH_REPEAT);
+
+	for (size_t i = 0; i < NPATTERNS; i++)
+	{
+		struct scan_state full = { .pattern = patterns[i] }, prefix = { .pattern = patterns[i] };
+		char literal[CHANNELLEN], label[BUFSIZE];
+		unsigned int visited = 0;
+		double start;
+
+		glob_literal_prefix(patterns[i], literal, sizeof literal);
+
+		start = bench_now();
+		for (unsigned int r = 0; r < BENCH_REPEAT; r++)
+			mowgli_patricia_foreach(projectsvs.channel_namespaces, scan_cb, &full);
+		snprintf(label, sizeof label, "%s: full scan", patterns[i]);
+		bench_report(label, BENCH_REPEAT, bench_now() - start);
+
+		start = bench_now();
+		for (unsigned int r = 0; r < BENCH_REPEAT; r++)
+			visited += channelns_foreach_prefix(literal, NULL, scan_cb, &prefix);
+		snprintf(label, sizeof label, "%s: prefix scan of \"%s\"", patterns[i], literal);
+		bench_report(label, BENCH_REPEAT, bench_now() - start);
+
+		if (full.matches != prefix.matches)
+		{
+			fprintf(stderr, "%s: full scan found %u, prefix scan %u\n", patterns[i],
+			        full.matches / BENCH_REPEAT, prefix.matches / BENCH_REPEAT);
+			return 1;
+		}
+
+		printf("    %u matches, %u keys visited by the prefix scan\n", full.matches / BENCH_REPEAT, visited / BENCH_REPEAT);
+	}
+
+	return 0;
+}
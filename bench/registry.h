@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Setup shared by the benchmarks linked against projectns/main.
+ */
+
+#ifndef ATHEME_FREENODE_BENCH_REGISTRY_H
+#define ATHEME_FREENODE_BENCH_REGISTRY_H
+
+#include "../projectns/main/main.h"
+#include "bench.h"
+
+// An empty registry as init_structures() leaves it, minus the hooks
+static inline void bench_registry_init(void)
+{
+	bench_init();
+
+	init_object_pools();
+	init_key_indexes();
+
+	projectsvs.projects = mowgli_patricia_create(strcasecanon);
+	projectsvs.channel_namespaces = mowgli_patricia_create(irccasecanon);
+	projectsvs.cloak_namespaces = mowgli_patricia_create(strcasecanon);
+
+	// the NAMESPACE_SEPARATORS default
+	projectsvs.config.namespace_separators = sstrdup("-");
+	namespace_separator_map['-'] = true;
+}
+
+// Drops every project, leaving the registry empty again
+static inline void bench_registry_clear(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+		project_destroy(p);
+}
+
+#endif
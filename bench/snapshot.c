@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Builds one synthetic registry, writes it both as text rows and as a binary
+ * snapshot, and times loading each into an empty registry the way startup does.
+ *
+ * The text rows go through the module's own database handlers via db_parse(),
+ * fed by a minimal reader for the flatfile format standing in for
+ * backend/opensex, which is a module of its own. Contacts are left out, as
+ * they would need real accounts behind them.
+ */
+
+#include "registry.h"
+
+#define BENCH_PROJECTS 50000U
+#define BENCH_ROUNDS   5U
+
+#define TEXT_PATH   "bench-projectns.db"
+#define BINARY_PATH "bench-projectns.bin"
+
+struct text_reader {
+	char *buf;
+	char *next;  // start of the next row
+	char *tok;   // rest of the current row
+};
+
+static bool text_read_next_row(database_handle_t *db)
+{
+	struct text_reader *r = db->priv;
+	char *eol;
+
+	if (!*r->next)
+		return false;
+
+	r->tok = r->next;
+	if ((eol = strchr(r->next, '\n')))
+	{
+		*eol = '\0';
+		r->next = eol + 1;
+	}
+	else
+		r->next += strlen(r->next);
+
+	db->line++;
+	db->token = 0;
+	return true;
+}
+
+static const char *text_read_word(database_handle_t *db)
+{
+	struct text_reader *r = db->priv;
+	char *word = r->tok, *sp;
+
+	if (!word || !*word)
+		return NULL;
+
+	if ((sp = strchr(word, ' ')))
+	{
+		*sp = '\0';
+		r->tok = sp + 1;
+	}
+	else
+		r->tok = word + strlen(word);
+
+	db->token++;
+	return word;
+}
+
+static const char *text_read_str(database_handle_t *db)
+{
+	struct text_reader *r = db->priv;
+	char *str = r->tok;
+
+	r->tok += strlen(r->tok);
+	db->token++;
+	return str;
+}
+
+static bool text_read_int(database_handle_t *db, int *res)
+{
+	const char *word = text_read_word(db);
+	char *end;
+
+	if (!word)
+		return false;
+
+	*res = strtol(word, &end, 10);
+	return !*end;
+}
+
+static bool text_read_uint(database_handle_t *db, unsigned int *res)
+{
+	const char *word = text_read_word(db);
+	char *end;
+
+	if (!word)
+		return false;
+
+	*res = strtoul(word, &end, 10);
+	return !*end;
+}
+
+static bool text_read_time(database_handle_t *db, time_t *res)
+{
+	const char *word = text_read_word(db);
+	char *end;
+
+	if (!word)
+		return false;
+
+	*res = strtoul(word, &end, 10);
+	return !*end;
+}
+
+static database_vtable_t text_vtable = {
+	.name          = "bench",
+	.read_next_row = text_read_next_row,
+	.read_word     = text_read_word,
+	.read_str      = text_read_str,
+	.read_int      = text_read_int,
+	.read_uint     = text_read_uint,
+	.read_time     = text_read_time,
+};
+
+static void load_text(void)
+{
+	struct text_reader r;
+	database_handle_t db = { .priv = &r, .vt = &text_vtable, .file = TEXT_PATH };
+	struct stat sb;
+	FILE *f;
+
+	if (!(f = fopen(TEXT_PATH, "r")) || fstat(fileno(f), &sb) != 0)
+	{
+		perror(TEXT_PATH);
+		exit(EXIT_FAILURE);
+	}
+
+	r.buf = smalloc(sb.st_size + 1);
+	r.buf[fread(r.buf, 1, sb.st_size, f)] = '\0';
+	r.next = r.buf;
+	r.tok = NULL;
+	fclose(f);
+
+	db_parse(&db);
+	free(r.buf);
+}
+
+static void load_binary(void)
+{
+	unsigned int seq;
+
+	if (!snapshot_load(BINARY_PATH, &seq))
+	{
+		fprintf(stderr, "%s: cannot load the snapshot\n", BINARY_PATH);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void build_registry(void)
+{
+	char buf[BUFSIZE];
+
+	for (unsigned int i = 0; i < BENCH_PROJECTS; i++)
+	{
+		snprintf(buf, sizeof buf, "project%u", i);
+		struct projectns *p = project_new(buf);
+
+		snprintf(buf, sizeof buf, "https://example.org/projects/%u", i);
+		p->reginfo = sstrdup(buf);
+		project_set_creation(p, 1262304000 + i * 600, i % 7 ? "staffer" : "otherstaffer");
+
+		snprintf(buf, sizeof buf, "#ns%u", i);
+		channelns_add(p, buf);
+		snprintf(buf, sizeof buf, "#ns%u-dev", i);
+		channelns_add(p, buf);
+		snprintf(buf, sizeof buf, "ns%u", i);
+		cloakns_add(p, buf);
+
+		for (unsigned int j = 0; j < i % 4; j++)
+			mark_new(p, 0, 1262304000 + i * 600, "AAAAAAAAA", "staffer", "approved after talking to the project lead");
+	}
+}
+
+static double timed_load(void (*load)(void))
+{
+	double start;
+
+	bench_registry_clear();
+
+	start = bench_now();
+	key_indexes_defer();
+	load();
+	key_indexes_settle();
+
+	return bench_now() - start;
+}
+
+int main(void)
+{
+	double text_ms = 0, binary_ms = 0;
+	unsigned int projects;
+	FILE *f;
+
+	bench_registry_init();
+	hooks_init();
+	db_init();
+	init_db();
+
+	build_registry();
+	projects = mowgli_patricia_size(projectsvs.projects);
+
+	if (!(f = fopen(TEXT_PATH, "w")))
+	{
+		perror(TEXT_PATH);
+		return 1;
+	}
+
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+		write_project_rows(&file_row_writer, f, p);
+	fclose(f);
+
+	if (!snapshot_write(BINARY_PATH, 1))
+	{
+		fprintf(stderr, "%s: cannot write the snapshot\n", BINARY_PATH);
+		return 1;
+	}
+
+	// alternate the two so neither gets a warmer cache throughout
+	for (unsigned int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		text_ms += timed_load(load_text);
+		if (mowgli_patricia_size(projectsvs.projects) != projects)
+		{
+			fprintf(stderr, "text rows loaded %u projects, expected %u\n", mowgli_patricia_size(projectsvs.projects), projects);
+			return 1;
+		}
+
+		binary_ms += timed_load(load_binary);
+		if (mowgli_patricia_size(projectsvs.projects) != projects)
+		{
+			fprintf(stderr, "snapshot loaded %u projects, expected %u\n", mowgli_patricia_size(projectsvs.projects), projects);
+			return 1;
+		}
+	}
+
+	printf("%u projects, %u channel and %u cloak namespaces, averaged over %u rounds:\n", projects,
+	       mowgli_patricia_size(projectsvs.channel_namespaces), mowgli_patricia_size(projectsvs.cloak_namespaces), BENCH_ROUNDS);
+	bench_report("text rows via db_parse()", projects, text_ms / BENCH_ROUNDS);
+	bench_report("binary snapshot via snapshot_load()", projects, binary_ms / BENCH_ROUNDS);
+
+	unlink(TEXT_PATH);
+	unlink(BINARY_PATH);
+
+	return 0;
+}
@@ -7,6 +7,7 @@
  */
 
 #include "atheme.h"
+#include "fn-banindex.h"
 
 static void cs_cmd_akick(sourceinfo_t *si, int parc, char *parv[]);
 static void cs_cmd_akick_add(sourceinfo_t *si, int parc, char *parv[]);
@@ -15,6 +16,9 @@ static void cs_cmd_akick_list(sourceinfo_t *si, int parc, char *parv[]);
 
 static void akick_timeout_check(void *arg);
 static void akickdel_list_create(void *arg);
+static void akickdel_list_drop(mychan_t *mc);
+static bool akick_persist_load(void);
+static void akick_persist_save(void);
 
 DECLARE_MODULE_V1
 (
@@ -40,18 +44,90 @@ typedef struct {
 
 	char host[NICKLEN + USERLEN + HOSTLEN + 4];
 
-	mowgli_node_t node;
+	size_t queue_pos;
+	mowgli_node_t chan_node;
 } akick_timeout_t;
 
-static time_t akickdel_next;
-static mowgli_list_t akickdel_list;
+/*
+ * Pending expirations are kept in a 4-ary min-heap ordered by expiration time,
+ * so adding or removing one is O(log n) and the next one due is always at the
+ * front. A single periodic timer expires whatever has come due, instead of a
+ * one-shot timer being re-armed whenever an earlier expiration is added.
+ */
+#define AKICK_QUEUE_ARITY	4
+#define AKICK_QUEUE_MIN_SIZE	256
+#define AKICK_TICK		1
+
+static struct {
+	akick_timeout_t **items;
+	size_t count;
+	size_t size;
+} akick_queue;
+
+/*
+ * The same expirations by channel and AKICK: a channel's AKICK on an entity
+ * has at most one pending expiration, keyed by the entity, and one on a
+ * hostmask is keyed by the mask itself. Masks are compared literally, ignoring
+ * case, just like chanacs_find_host_literal() does; a mask that merely matches
+ * another is a different AKICK with its own expiration. Under the channel's
+ * own address alone is the list of all of its expirations, so dropping it does
+ * not have to look through everyone else's; channels without any have no entry.
+ */
+static mowgli_patricia_t *akick_index;
+
 static mowgli_patricia_t *cs_akick_cmds;
 static mowgli_eventloop_timer_t *akick_timeout_check_timer = NULL;
 
 static akick_timeout_t *akick_add_timeout(mychan_t *mc, myentity_t *mt, const char *host, time_t expireson);
+static void akick_del_timeout(mychan_t *mc, myentity_t *mt, const char *host);
+
+static void akick_index_free(const char *key, void *data, void *privdata);
 
 static mowgli_heap_t *akick_timeout_heap;
 
+/*
+ * The expirations are rebuilt from the AKICK metadata after loading, a bounded
+ * number of access entries per event loop iteration so a large database does
+ * not hold up everything else. Each slice schedules the next and the iteration
+ * over mclist resumes where it left off; akickdel_list_drop() keeps it valid
+ * when channels go away meanwhile.
+ */
+#define AKICK_REBUILD_SLICE	10000
+
+static struct {
+	mowgli_eventloop_timer_t *timer;
+	mowgli_patricia_iteration_state_t state;
+	size_t channels, total, next_report;
+	unsigned int queued, expired, slices;
+	time_t started;
+} akick_rebuild;
+
+/*
+ * On reload the queue, its index, the allocator its entries live in and any
+ * unfinished rebuild are handed to the new instance instead of rescanning
+ * every channel. Bump AKICK_PERSIST_VERSION whenever any of those change
+ * layout; a record of another version is not trusted and the expirations are
+ * rebuilt instead.
+ */
+#define AKICK_PERSIST_NAME	"atheme.freenode.cs_akick.persist"
+#define AKICK_PERSIST_VERSION	3
+
+struct akick_persist {
+	unsigned int version;
+
+	mowgli_heap_t *timeout_heap;
+	akick_timeout_t **items;
+	size_t count;
+	size_t size;
+	mowgli_patricia_t *index;
+
+	bool rebuilding;
+	mowgli_patricia_iteration_state_t rebuild_state;
+	size_t channels, total, next_report;
+	unsigned int queued, expired, slices;
+	time_t started;
+};
+
 void _modinit(module_t *m)
 {
 	MODULE_CONFLICT(m, "chanserv/akick")
@@ -65,15 +141,24 @@ void _modinit(module_t *m)
 	command_add(&cs_akick_del, cs_akick_cmds);
 	command_add(&cs_akick_list, cs_akick_cmds);
 
-        akick_timeout_heap = mowgli_heap_create(sizeof(akick_timeout_t), 512, BH_NOW);
+	if (!akick_persist_load())
+	{
+		akick_timeout_heap = mowgli_heap_create(sizeof(akick_timeout_t), 512, BH_NOW);
+
+		if (akick_timeout_heap == NULL)
+		{
+			m->mflags = MODTYPE_FAIL;
+			return;
+		}
 
-    	if (akick_timeout_heap == NULL)
-    	{
-    		m->mflags = MODTYPE_FAIL;
-    		return;
-    	}
+		akick_index = mowgli_patricia_create(strcasecanon);
 
-	mowgli_timer_add_once(base_eventloop, "akickdel_list_create", akickdel_list_create, NULL, 0);
+		akick_rebuild.timer = mowgli_timer_add_once(base_eventloop, "akickdel_list_create", akickdel_list_create, NULL, 0);
+	}
+
+	hook_add_channel_drop(akickdel_list_drop);
+
+	akick_timeout_check_timer = mowgli_timer_add(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, AKICK_TICK);
 }
 
 void _moddeinit(module_unload_intent_t intent)
@@ -85,14 +170,31 @@ void _moddeinit(module_unload_intent_t intent)
 	command_delete(&cs_akick_del, cs_akick_cmds);
 	command_delete(&cs_akick_list, cs_akick_cmds);
 
-	mowgli_heap_destroy(akick_timeout_heap);
 	mowgli_patricia_destroy(cs_akick_cmds, NULL, NULL);
 
-	if (akickdel_next != 0)
-		mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
+	mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
+
+	hook_del_channel_drop(akickdel_list_drop);
+
+	if (intent == MODULE_UNLOAD_INTENT_RELOAD)
+		akick_persist_save();
+	else
+	{
+		mowgli_heap_destroy(akick_timeout_heap);
+		mowgli_patricia_destroy(akick_index, akick_index_free, NULL);
+		free(akick_queue.items);
+	}
+
+	if (akick_rebuild.timer != NULL)
+		mowgli_timer_destroy(base_eventloop, akick_rebuild.timer);
+
+	akick_timeout_heap = NULL;
+	akick_index = NULL;
+	memset(&akick_queue, 0, sizeof akick_queue);
+	memset(&akick_rebuild, 0, sizeof akick_rebuild);
 }
 
-static void clear_bans_matching_entity(mychan_t *mc, myentity_t *mt)
+static void clear_bans_matching_entity(mychan_t *mc, myentity_t *mt, struct ban_index *bans)
 {
 	mowgli_node_t *n;
 	myuser_t *tmu;
@@ -114,12 +216,12 @@ static void clear_bans_matching_entity(mychan_t *mc, myentity_t *mt)
 		snprintf(mask, BUFSIZE, "*!*@%s", tu->vhost);
 		mask[BUFSIZE - 1] = '\0';
 
-		chanban_t *cb = chanban_find(mc->chan, mask, 'b');
+		chanban_t *cb = ban_index_find(bans, mc->chan, mask, 'b');
 
 		if (cb)
 		{
 			modestack_mode_param(chansvs.nick, mc->chan, MTYPE_DEL, cb->type, cb->mask);
-			chanban_delete(cb);
+			ban_index_delete(bans, cb);
 		}
 	}
 
@@ -331,7 +433,6 @@ void cs_cmd_akick_add(sourceinfo_t *si, int parc, char *parv[])
 
 		if (duration > 0)
 		{
-			akick_timeout_t *timeout;
 			time_t expireson = ca2->tmodified+duration;
 
 			snprintf(expiry, sizeof expiry, "%ld", expireson);
@@ -341,16 +442,7 @@ void cs_cmd_akick_add(sourceinfo_t *si, int parc, char *parv[])
 			logcommand(si, CMDLOG_SET, "AKICK:ADD: \2%s\2 on \2%s\2, expires in %s.", uname, mc->name,timediff(duration));
 			command_success_nodata(si, _("AKICK on \2%s\2 was successfully added for \2%s\2 and will expire in %s."), uname, mc->name,timediff(duration) );
 
-			timeout = akick_add_timeout(mc, NULL, uname, expireson);
-
-			if (akickdel_next == 0 || akickdel_next > timeout->expiration)
-			{
-				if (akickdel_next != 0)
-					mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
-
-				akickdel_next = timeout->expiration;
-				akick_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, akickdel_next - CURRTIME);
-			}
+			akick_add_timeout(mc, NULL, uname, expireson);
 		}
 		else
 		{
@@ -397,7 +489,6 @@ void cs_cmd_akick_add(sourceinfo_t *si, int parc, char *parv[])
 
 		if (duration > 0)
 		{
-			akick_timeout_t *timeout;
 			time_t expireson = ca2->tmodified+duration;
 
 			snprintf(expiry, sizeof expiry, "%ld", expireson);
@@ -407,16 +498,7 @@ void cs_cmd_akick_add(sourceinfo_t *si, int parc, char *parv[])
 			verbose(mc, "\2%s\2 added \2%s\2 to the AKICK list, expires in %s.", get_source_name(si), mt->name, timediff(duration));
 			logcommand(si, CMDLOG_SET, "AKICK:ADD: \2%s\2 on \2%s\2, expires in %s", mt->name, mc->name, timediff(duration));
 
-			timeout = akick_add_timeout(mc, mt, mt->name, expireson);
-
-			if (akickdel_next == 0 || akickdel_next > timeout->expiration)
-			{
-				if (akickdel_next != 0)
-					mowgli_timer_destroy(base_eventloop, akick_timeout_check_timer);
-
-				akickdel_next = timeout->expiration;
-				akick_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, akickdel_next - CURRTIME);
-			}
+			akick_add_timeout(mc, mt, mt->name, expireson);
 		}
 		else
 		{
@@ -438,7 +520,6 @@ void cs_cmd_akick_del(sourceinfo_t *si, int parc, char *parv[])
 	mychan_t *mc;
 	hook_channel_acl_req_t req;
 	chanacs_t *ca;
-	mowgli_node_t *n, *tn;
 	char *chan = parv[0];
 	char *uname = parv[1];
 
@@ -462,8 +543,8 @@ void cs_cmd_akick_del(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	akick_timeout_t *timeout;
 	chanban_t *cb;
+	struct ban_index bans;
 
 	if ((chanacs_source_flags(mc, si) & (CA_FLAGS | CA_REMOVE)) != (CA_FLAGS | CA_REMOVE))
 	{
@@ -500,15 +581,7 @@ void cs_cmd_akick_del(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "AKICK:DEL: \2%s\2 on \2%s\2", uname, mc->name);
 		command_success_nodata(si, _("\2%s\2 has been removed from the AKICK list for \2%s\2."), uname, mc->name);
 
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, akickdel_list.head)
-		{
-			timeout = n->data;
-			if (!match(timeout->host, uname) && timeout->chan == mc)
-			{
-				mowgli_node_delete(&timeout->node, &akickdel_list);
-				mowgli_heap_free(akick_timeout_heap, timeout);
-			}
-		}
+		akick_del_timeout(mc, NULL, uname);
 
 		if (mc->chan != NULL && (cb = chanban_find(mc->chan, uname, 'b')))
 		{
@@ -525,17 +598,11 @@ void cs_cmd_akick_del(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	clear_bans_matching_entity(mc, mt);
+	ban_index_init(&bans);
+	clear_bans_matching_entity(mc, mt, &bans);
+	ban_index_destroy(&bans);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, akickdel_list.head)
-	{
-		timeout = n->data;
-		if (timeout->entity == mt && timeout->chan == mc)
-		{
-			mowgli_node_delete(&timeout->node, &akickdel_list);
-			mowgli_heap_free(akick_timeout_heap, timeout);
-		}
-	}
+	akick_del_timeout(mc, mt, NULL);
 
 	req.ca = ca;
 	req.oldlevel = ca->level;
@@ -667,36 +734,163 @@ void cs_cmd_akick_list(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_GET, "AKICK:LIST: \2%s\2", mc->name);
 }
 
+static inline bool akick_queue_before(size_t a, size_t b)
+{
+	return akick_queue.items[a]->expiration < akick_queue.items[b]->expiration;
+}
+
+static inline void akick_queue_swap(size_t a, size_t b)
+{
+	akick_timeout_t *tmp = akick_queue.items[a];
+
+	akick_queue.items[a] = akick_queue.items[b];
+	akick_queue.items[b] = tmp;
+	akick_queue.items[a]->queue_pos = a;
+	akick_queue.items[b]->queue_pos = b;
+}
+
+static size_t akick_queue_sift_up(size_t pos)
+{
+	while (pos > 0)
+	{
+		size_t parent = (pos - 1) / AKICK_QUEUE_ARITY;
+
+		if (!akick_queue_before(pos, parent))
+			break;
+
+		akick_queue_swap(pos, parent);
+		pos = parent;
+	}
+
+	return pos;
+}
+
+static void akick_queue_sift_down(size_t pos)
+{
+	for (;;)
+	{
+		size_t first = pos * AKICK_QUEUE_ARITY + 1;
+		size_t best = pos;
+		size_t i;
+
+		for (i = first; i < first + AKICK_QUEUE_ARITY && i < akick_queue.count; i++)
+			if (akick_queue_before(i, best))
+				best = i;
+
+		if (best == pos)
+			break;
+
+		akick_queue_swap(pos, best);
+		pos = best;
+	}
+}
+
+static void akick_queue_push(akick_timeout_t *timeout)
+{
+	if (akick_queue.count == akick_queue.size)
+	{
+		akick_queue.size = akick_queue.size ? akick_queue.size * 2 : AKICK_QUEUE_MIN_SIZE;
+		akick_queue.items = srealloc(akick_queue.items, akick_queue.size * sizeof *akick_queue.items);
+	}
+
+	timeout->queue_pos = akick_queue.count;
+	akick_queue.items[akick_queue.count++] = timeout;
+	akick_queue_sift_up(timeout->queue_pos);
+}
+
+static void akick_queue_remove(akick_timeout_t *timeout)
+{
+	size_t pos = timeout->queue_pos;
+
+	if (pos == --akick_queue.count)
+		return;
+
+	/* the last entry takes this spot, and may belong above or below it */
+	akick_queue.items[pos] = akick_queue.items[akick_queue.count];
+	akick_queue.items[pos]->queue_pos = pos;
+
+	if (akick_queue_sift_up(pos) == pos)
+		akick_queue_sift_down(pos);
+}
+
+static void akick_timeout_key(char *buf, size_t len, mychan_t *mc, myentity_t *mt, const char *host)
+{
+	if (mt != NULL)
+		snprintf(buf, len, "%p %p", (void *)mc, (void *)mt);
+	else
+		snprintf(buf, len, "%p !%s", (void *)mc, host);
+}
+
+static mowgli_list_t *akick_chan_timeouts(mychan_t *mc, bool create)
+{
+	mowgli_list_t *l;
+	char key[BUFSIZE];
+
+	snprintf(key, sizeof key, "%p", (void *)mc);
+
+	if ((l = mowgli_patricia_retrieve(akick_index, key)) == NULL && create)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(akick_index, key, l);
+	}
+
+	return l;
+}
+
+static void akick_index_free(const char *key, void *data, void *privdata)
+{
+	/* the channel lists are the only entries without a space in their key */
+	if (strchr(key, ' ') == NULL)
+		mowgli_list_free(data);
+}
+
+static void akick_free_timeout(akick_timeout_t *timeout)
+{
+	mowgli_list_t *l;
+	char key[BUFSIZE];
+
+	akick_timeout_key(key, sizeof key, timeout->chan, timeout->entity, timeout->host);
+	mowgli_patricia_delete(akick_index, key);
+
+	l = akick_chan_timeouts(timeout->chan, false);
+	mowgli_node_delete(&timeout->chan_node, l);
+
+	if (!l->count)
+	{
+		snprintf(key, sizeof key, "%p", (void *)timeout->chan);
+		mowgli_patricia_delete(akick_index, key);
+		mowgli_list_free(l);
+	}
+
+	akick_queue_remove(timeout);
+	mowgli_heap_free(akick_timeout_heap, timeout);
+}
+
 void akick_timeout_check(void *arg)
 {
-	mowgli_node_t *n, *tn;
 	akick_timeout_t *timeout;
 	chanacs_t *ca;
 	mychan_t *mc;
 
 	chanban_t *cb;
-	akickdel_next = 0;
+	struct ban_index bans;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, akickdel_list.head)
+	/* bans of every channel with an AKICK expiring, looked up as needed */
+	ban_index_init(&bans);
+
+	while (akick_queue.count > 0 && akick_queue.items[0]->expiration <= CURRTIME)
 	{
-		timeout = n->data;
+		timeout = akick_queue.items[0];
 		mc = timeout->chan;
 
-		if (timeout->expiration > CURRTIME)
-		{
-			akickdel_next = timeout->expiration;
-			akick_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "akick_timeout_check", akick_timeout_check, NULL, akickdel_next - CURRTIME);
-			break;
-		}
-
 		ca = NULL;
 
 		if (timeout->entity == NULL)
 		{
-			if ((ca = chanacs_find_host_literal(mc, timeout->host, CA_AKICK)) && mc->chan != NULL && (cb = chanban_find(mc->chan, ca->host, 'b')))
+			if ((ca = chanacs_find_host_literal(mc, timeout->host, CA_AKICK)) && mc->chan != NULL && (cb = ban_index_find(&bans, mc->chan, ca->host, 'b')))
 			{
 				modestack_mode_param(chansvs.nick, mc->chan, MTYPE_DEL, cb->type, cb->mask);
-				chanban_delete(cb);
+				ban_index_delete(&bans, cb);
 			}
 		}
 		else
@@ -704,13 +898,11 @@ void akick_timeout_check(void *arg)
 			ca = chanacs_find_literal(mc, timeout->entity, CA_AKICK);
 			if (ca == NULL)
 			{
-				mowgli_node_delete(&timeout->node, &akickdel_list);
-				mowgli_heap_free(akick_timeout_heap, timeout);
-
+				akick_free_timeout(timeout);
 				continue;
 			}
 
-			clear_bans_matching_entity(mc, timeout->entity);
+			clear_bans_matching_entity(mc, timeout->entity, &bans);
 		}
 
 		if (ca)
@@ -719,15 +911,28 @@ void akick_timeout_check(void *arg)
 			chanacs_close(ca);
 		}
 
-		mowgli_node_delete(&timeout->node, &akickdel_list);
-		mowgli_heap_free(akick_timeout_heap, timeout);
+		akick_free_timeout(timeout);
 	}
+
+	ban_index_destroy(&bans);
 }
 
+/* Sets when an AKICK expires, replacing any expiration it already had. */
 static akick_timeout_t *akick_add_timeout(mychan_t *mc, myentity_t *mt, const char *host, time_t expireson)
 {
-	mowgli_node_t *n;
-	akick_timeout_t *timeout, *timeout2;
+	akick_timeout_t *timeout;
+	char key[BUFSIZE];
+
+	akick_timeout_key(key, sizeof key, mc, mt, host);
+
+	if ((timeout = mowgli_patricia_retrieve(akick_index, key)) != NULL)
+	{
+		akick_queue_remove(timeout);
+		timeout->expiration = expireson;
+		akick_queue_push(timeout);
+
+		return timeout;
+	}
 
 	timeout = mowgli_heap_alloc(akick_timeout_heap);
 
@@ -737,64 +942,230 @@ static akick_timeout_t *akick_add_timeout(mychan_t *mc, myentity_t *mt, const ch
 
 	mowgli_strlcpy(timeout->host, host, sizeof timeout->host);
 
-	MOWGLI_ITER_FOREACH_PREV(n, akickdel_list.tail)
-	{
-		timeout2 = n->data;
-		if (timeout2->expiration <= timeout->expiration)
-			break;
-	}
-	if (n == NULL)
-		mowgli_node_add_head(timeout, &timeout->node, &akickdel_list);
-	else if (n->next == NULL)
-		mowgli_node_add(timeout, &timeout->node, &akickdel_list);
-	else
-		mowgli_node_add_before(timeout, &timeout->node, &akickdel_list, n->next);
+	akick_queue_push(timeout);
+	mowgli_patricia_add(akick_index, key, timeout);
+	mowgli_node_add(timeout, &timeout->chan_node, akick_chan_timeouts(mc, true));
 
 	return timeout;
 }
 
-void akickdel_list_create(void *arg)
+/*
+ * Drops the pending expiration of an AKICK being deleted: that of the entity
+ * if one is given, otherwise that of exactly this mask.
+ */
+static void akick_del_timeout(mychan_t *mc, myentity_t *mt, const char *host)
+{
+	akick_timeout_t *timeout;
+	char key[BUFSIZE];
+
+	akick_timeout_key(key, sizeof key, mc, mt, host);
+
+	if ((timeout = mowgli_patricia_retrieve(akick_index, key)) != NULL)
+		akick_free_timeout(timeout);
+}
+
+/* Returns the number of access entries looked at. */
+static unsigned int akickdel_list_scan(mychan_t *mc)
 {
-	mychan_t *mc;
 	mowgli_node_t *n, *tn;
 	chanacs_t *ca;
 	metadata_t *md;
 	time_t expireson;
+	unsigned int scanned = 0;
 
-	mowgli_patricia_iteration_state_t state;
-
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
 	{
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
-		{
-			ca = (chanacs_t *)n->data;
+		ca = (chanacs_t *)n->data;
+		scanned++;
 
-			if (!(ca->level & CA_AKICK))
-				continue;
+		if (!(ca->level & CA_AKICK))
+			continue;
 
-			md = metadata_find(ca, "expires");
+		md = metadata_find(ca, "expires");
 
-			if (!md)
-				continue;
+		if (!md)
+			continue;
 
-			expireson = atol(md->value);
+		expireson = atol(md->value);
 
-			if (CURRTIME > expireson)
-			{
-				chanacs_modify_simple(ca, 0, CA_AKICK);
-				chanacs_close(ca);
-			}
+		if (CURRTIME > expireson)
+		{
+			chanacs_modify_simple(ca, 0, CA_AKICK);
+			chanacs_close(ca);
+			akick_rebuild.expired++;
+		}
+		else
+		{
+			/* overcomplicate the logic here a tiny bit */
+			if (ca->host == NULL && ca->entity != NULL)
+				akick_add_timeout(mc, ca->entity, entity(ca->entity)->name, expireson);
+			else if (ca->host != NULL && ca->entity == NULL)
+				akick_add_timeout(mc, NULL, ca->host, expireson);
 			else
-			{
-				/* overcomplicate the logic here a tiny bit */
-				if (ca->host == NULL && ca->entity != NULL)
-					akick_add_timeout(mc, ca->entity, entity(ca->entity)->name, expireson);
-				else if (ca->host != NULL && ca->entity == NULL)
-					akick_add_timeout(mc, NULL, ca->host, expireson);
-			}
+				continue;
+
+			akick_rebuild.queued++;
+		}
+	}
+
+	return scanned;
+}
+
+void akickdel_list_create(void *arg)
+{
+	mychan_t *mc;
+	unsigned int scanned = 0;
+
+	akick_rebuild.timer = NULL;
+
+	/* not in _modinit: at startup the database has not been loaded yet */
+	if (akick_rebuild.slices++ == 0)
+	{
+		mowgli_patricia_foreach_start(mclist, &akick_rebuild.state);
+		akick_rebuild.total = mowgli_patricia_size(mclist);
+		akick_rebuild.started = CURRTIME;
+	}
+
+	while (scanned < AKICK_REBUILD_SLICE && (mc = mowgli_patricia_foreach_cur(mclist, &akick_rebuild.state)) != NULL)
+	{
+		scanned += akickdel_list_scan(mc);
+		akick_rebuild.channels++;
+		mowgli_patricia_foreach_next(mclist, &akick_rebuild.state);
+	}
+
+	if (mc != NULL)
+	{
+		if (akick_rebuild.channels >= akick_rebuild.next_report)
+		{
+			slog(LG_DEBUG, "akickdel_list_create(): %zu of %zu channels scanned", akick_rebuild.channels, akick_rebuild.total);
+			akick_rebuild.next_report = akick_rebuild.channels + akick_rebuild.total / 10;
 		}
+
+		akick_rebuild.timer = mowgli_timer_add_once(base_eventloop, "akickdel_list_create", akickdel_list_create, NULL, 0);
+		return;
+	}
+
+	slog(LG_INFO, "akickdel_list_create(): %zu channels scanned in %u slices (%ld seconds): %u AKICKs queued for expiry, %u already expired",
+		akick_rebuild.channels, akick_rebuild.slices, (long)(CURRTIME - akick_rebuild.started),
+		akick_rebuild.queued, akick_rebuild.expired);
+}
+
+/* A dropped channel's pending expirations go with it. */
+static void akick_drop_timeouts(mychan_t *mc)
+{
+	mowgli_list_t *l;
+
+	/* the list itself goes away with its last entry */
+	while ((l = akick_chan_timeouts(mc, false)) != NULL)
+		akick_free_timeout(l->head->data);
+}
+
+/*
+ * The iteration state holds on to the channel to scan next and the one after
+ * it. Either may be dropped between slices; the first is then simply skipped,
+ * and for the second the first is scanned right away so the iteration can step
+ * over both.
+ */
+static void akickdel_list_drop(mychan_t *mc)
+{
+	mowgli_patricia_iteration_state_t peek;
+	mychan_t *cur;
+
+	akick_drop_timeouts(mc);
+
+	if (akick_rebuild.timer == NULL || akick_rebuild.slices == 0)
+		return;
+
+	if ((cur = mowgli_patricia_foreach_cur(mclist, &akick_rebuild.state)) == NULL)
+		return;
+
+	if (cur == mc)
+	{
+		mowgli_patricia_foreach_next(mclist, &akick_rebuild.state);
+		return;
+	}
+
+	peek = akick_rebuild.state;
+	mowgli_patricia_foreach_next(mclist, &peek);
+
+	if (mowgli_patricia_foreach_cur(mclist, &peek) != mc)
+		return;
+
+	akickdel_list_scan(cur);
+	akick_rebuild.channels++;
+
+	mowgli_patricia_foreach_next(mclist, &akick_rebuild.state);
+	mowgli_patricia_foreach_next(mclist, &akick_rebuild.state);
+}
+
+static void akick_persist_save(void)
+{
+	struct akick_persist *rec = smalloc(sizeof *rec);
+
+	rec->version = AKICK_PERSIST_VERSION;
+
+	rec->timeout_heap = akick_timeout_heap;
+	rec->items = akick_queue.items;
+	rec->count = akick_queue.count;
+	rec->size = akick_queue.size;
+	rec->index = akick_index;
+
+	rec->rebuilding = akick_rebuild.timer != NULL;
+	rec->rebuild_state = akick_rebuild.state;
+	rec->channels = akick_rebuild.channels;
+	rec->total = akick_rebuild.total;
+	rec->next_report = akick_rebuild.next_report;
+	rec->queued = akick_rebuild.queued;
+	rec->expired = akick_rebuild.expired;
+	rec->slices = akick_rebuild.slices;
+	rec->started = akick_rebuild.started;
+
+	mowgli_global_storage_put(AKICK_PERSIST_NAME, rec);
+}
+
+/* Returns false if there is nothing usable to restore. */
+static bool akick_persist_load(void)
+{
+	struct akick_persist *rec = mowgli_global_storage_get(AKICK_PERSIST_NAME);
+
+	if (rec == NULL)
+		return false;
+
+	mowgli_global_storage_free(AKICK_PERSIST_NAME);
+
+	if (rec->version != AKICK_PERSIST_VERSION)
+	{
+		/* we do not know its layout, so its entries cannot be freed either */
+		slog(LG_ERROR, "freenode/cs_akick: ignoring AKICK expiry data of version %u (expected %u); rebuilding it",
+			rec->version, AKICK_PERSIST_VERSION);
+		free(rec);
+		return false;
 	}
+
+	akick_timeout_heap = rec->timeout_heap;
+	akick_queue.items = rec->items;
+	akick_queue.count = rec->count;
+	akick_queue.size = rec->size;
+	akick_index = rec->index;
+
+	akick_rebuild.state = rec->rebuild_state;
+	akick_rebuild.channels = rec->channels;
+	akick_rebuild.total = rec->total;
+	akick_rebuild.next_report = rec->next_report;
+	akick_rebuild.queued = rec->queued;
+	akick_rebuild.expired = rec->expired;
+	akick_rebuild.slices = rec->slices;
+	akick_rebuild.started = rec->started;
+
+	if (rec->rebuilding)
+		akick_rebuild.timer = mowgli_timer_add_once(base_eventloop, "akickdel_list_create", akickdel_list_create, NULL, 0);
+
+	slog(LG_DEBUG, "freenode/cs_akick: restored %zu pending AKICK expirations", akick_queue.count);
+
+	free(rec);
+	return true;
 }
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
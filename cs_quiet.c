@@ -7,6 +7,7 @@
  */
 
 #include "atheme.h"
+#include "fn-banindex.h"
 
 DECLARE_MODULE_V1
 (
@@ -371,6 +372,7 @@ static void cs_cmd_unquiet(sourceinfo_t *si, int parc, char *parv[])
 	char *targetlist;
 	char *strtokctx;
 	char target_extban[BUFSIZE];
+	struct ban_index bans;
 
 	if (!channel)
 	{
@@ -411,6 +413,9 @@ static void cs_cmd_unquiet(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	/* several masks may be given, so look them up without rescanning the list each time */
+	ban_index_init(&bans);
+
 	targetlist = strdup(target);
 	target = strtok_r(targetlist, " ", &strtokctx);
 	do
@@ -435,7 +440,7 @@ static void cs_cmd_unquiet(sourceinfo_t *si, int parc, char *parv[])
 
 				logcommand(si, CMDLOG_DO, "UNQUIET: \2%s\2 on \2%s\2 (for user \2%s\2)", cb->mask, mc->name, hostbuf2);
 				modestack_mode_param(chansvs.nick, c, MTYPE_DEL, cb->type, cb->mask);
-				chanban_delete(cb);
+				ban_index_delete(&bans, cb);
 				count++;
 			}
 			if (count > 0)
@@ -451,14 +456,14 @@ static void cs_cmd_unquiet(sourceinfo_t *si, int parc, char *parv[])
 			continue;
 		}
 		else if (make_extbanmask(target_extban, sizeof target_extban, target),
-				(cb = chanban_find(c, target_extban, banlike_char)) != NULL ||
+				(cb = ban_index_find(&bans, c, target_extban, banlike_char)) != NULL ||
 				validhostmask(target))
 		{
 			if (cb != NULL)
 			{
 				modestack_mode_param(chansvs.nick, c, MTYPE_DEL, banlike_char, cb->mask);
 				notify_victims(si, c, cb, MTYPE_DEL);
-				chanban_delete(cb);
+				ban_index_delete(&bans, cb);
 				logcommand(si, CMDLOG_DO, "UNQUIET: \2%s\2 on \2%s\2", target_extban, mc->name);
 				if (si->su == NULL || !chanuser_find(mc->chan, si->su))
 					command_success_nodata(si, _("Unquieted \2%s\2 on \2%s\2."), target_extban, channel);
@@ -476,6 +481,8 @@ static void cs_cmd_unquiet(sourceinfo_t *si, int parc, char *parv[])
 		}
 	} while ((target = strtok_r(NULL, " ", &strtokctx)) != NULL);
 	free(targetlist);
+
+	ban_index_destroy(&bans);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
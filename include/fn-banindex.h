@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2019 Nicole Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Ban list lookups by mask for modules removing many bans at once.
+ */
+
+#ifndef ATHEME_FREENODE_BANINDEX_H
+#define ATHEME_FREENODE_BANINDEX_H
+
+#include <atheme.h>
+
+// chanban_find() walks a channel's whole ban list on every call, which adds up
+// when clearing many masks from a channel carrying thousands of bans. A
+// ban_index maps (channel, type, mask) to the chanban_t the same way, comparing
+// masks with irccasecmp(), after one walk over each channel's list.
+//
+// Atheme has no hook on ban list changes, so an index only stays correct while
+// the lists do not change under it: keep one for the duration of a single
+// operation and remove bans through ban_index_delete() meanwhile.
+//
+// Indexing a channel costs a node per ban, more than the walk it saves when
+// only one mask is looked up there, so the first lookup in a channel still
+// uses chanban_find() and the channel is only indexed on the second.
+
+struct ban_index {
+	mowgli_patricia_t *bans;
+	mowgli_patricia_t *channels;  // the channel itself once indexed, &ban_index_seen before
+};
+
+static char ban_index_seen;
+
+static inline void ban_index_key(char *buf, size_t len, const channel_t *c, int type, const char *mask)
+{
+	snprintf(buf, len, "%p %c%s", (const void *)c, type, mask);
+}
+
+static inline void ban_index_init(struct ban_index *bi)
+{
+	bi->bans = NULL;
+	bi->channels = NULL;
+}
+
+static inline void ban_index_add_channel(struct ban_index *bi, channel_t *c)
+{
+	mowgli_node_t *n;
+	char key[BUFSIZE];
+
+	if (bi->bans == NULL)
+		bi->bans = mowgli_patricia_create(irccasecanon);
+
+	snprintf(key, sizeof key, "%p", (void *)c);
+	mowgli_patricia_delete(bi->channels, key);
+	mowgli_patricia_add(bi->channels, key, c);
+
+	MOWGLI_ITER_FOREACH(n, c->bans.head)
+	{
+		chanban_t *cb = n->data;
+
+		// chanban_add() refuses masks already on the list, so keys are unique
+		ban_index_key(key, sizeof key, c, cb->type, cb->mask);
+		mowgli_patricia_add(bi->bans, key, cb);
+	}
+}
+
+// Same result as chanban_find(c, mask, type)
+static inline chanban_t *ban_index_find(struct ban_index *bi, channel_t *c, const char *mask, int type)
+{
+	char key[BUFSIZE];
+	void *state;
+
+	if (bi->channels == NULL)
+		bi->channels = mowgli_patricia_create(NULL);
+
+	snprintf(key, sizeof key, "%p", (void *)c);
+	if ((state = mowgli_patricia_retrieve(bi->channels, key)) == NULL)
+	{
+		mowgli_patricia_add(bi->channels, key, &ban_index_seen);
+		return chanban_find(c, mask, type);
+	}
+
+	if (state == &ban_index_seen)
+		ban_index_add_channel(bi, c);
+
+	ban_index_key(key, sizeof key, c, type, mask);
+	return mowgli_patricia_retrieve(bi->bans, key);
+}
+
+// chanban_delete() for a ban that may have been indexed
+static inline void ban_index_delete(struct ban_index *bi, chanban_t *cb)
+{
+	char key[BUFSIZE];
+
+	if (bi->bans != NULL)
+	{
+		ban_index_key(key, sizeof key, cb->chan, cb->type, cb->mask);
+		if (mowgli_patricia_retrieve(bi->bans, key) == cb)
+			mowgli_patricia_delete(bi->bans, key);
+	}
+
+	chanban_delete(cb);
+}
+
+static inline void ban_index_destroy(struct ban_index *bi)
+{
+	if (bi->bans != NULL)
+		mowgli_patricia_destroy(bi->bans, NULL, NULL);
+	if (bi->channels != NULL)
+		mowgli_patricia_destroy(bi->channels, NULL, NULL);
+	ban_index_init(bi);
+}
+
+#endif
@@ -16,81 +16,235 @@ static command_t ps_audit = {
 	.name       = "AUDIT",
 	.desc       = N_("Lists projects with incomplete registrations"),
 	.access     = PRIV_PROJECT_AUSPEX,
-	.maxparc    = 1,
+	.maxparc    = 5,
 	.cmd        = cmd_audit,
 	.help       = { .path = "freenode/project_audit" },
 };
 
+static void show_project(sourceinfo_t *si, struct projectns *project)
+{
+	char channels[BUFSIZE] = "";
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
+	{
+		if (channels[0])
+			mowgli_strlcat(channels, ", ", sizeof channels);
+		mowgli_strlcat(channels, (const char*)n->data, sizeof channels);
+	}
+
+	char contacts[BUFSIZE] = "";
+	MOWGLI_ITER_FOREACH(n, project->contacts.head)
+	{
+		struct project_contact *contact = n->data;
+		if (contacts[0])
+			mowgli_strlcat(contacts, ", ", sizeof contacts);
+		mowgli_strlcat(contacts, ((myentity_t*)contact->mu)->name, sizeof contacts);
+	}
+
+	command_success_nodata(si, _("- %s (%s; %s)"), project->name,
+	                           (channels[0] ? channels : _("\2no channels\2")),
+	                           (contacts[0] ? contacts : _("\2no contacts\2")));
+}
+
+static int project_name_cmp(const void *a, const void *b)
+{
+	const struct projectns * const *pa = a;
+	const struct projectns * const *pb = b;
+
+	return strcasecmp((*pa)->name, (*pb)->name);
+}
+
+/* The names of one page: with a LIMIT, a max-heap of the smallest names seen
+ * so far, so finding a page out of k flagged projects takes O(k log limit)
+ * rather than sorting all of them.
+ */
+struct audit_page
+{
+	struct projectns **heap;
+	size_t count;
+	size_t size;        // the LIMIT, or room for every candidate without one
+	size_t candidates;  // everything past the cursor, shown or not
+};
+
+static inline bool page_after(const struct audit_page *pg, size_t a, size_t b)
+{
+	return strcasecmp(pg->heap[a]->name, pg->heap[b]->name) > 0;
+}
+
+static inline void page_swap(struct audit_page *pg, size_t a, size_t b)
+{
+	struct projectns *tmp = pg->heap[a];
+
+	pg->heap[a] = pg->heap[b];
+	pg->heap[b] = tmp;
+}
+
+static void page_offer(struct audit_page *pg, struct projectns *project)
+{
+	size_t pos;
+
+	pg->candidates++;
+
+	if (pg->count < pg->size)
+	{
+		pos = pg->count++;
+		pg->heap[pos] = project;
+
+		while (pos > 0 && page_after(pg, pos, (pos - 1) / 2))
+		{
+			page_swap(pg, pos, (pos - 1) / 2);
+			pos = (pos - 1) / 2;
+		}
+
+		return;
+	}
+
+	if (!pg->count || strcasecmp(project->name, pg->heap[0]->name) >= 0)
+		return;
+
+	pg->heap[0] = project;
+
+	for (pos = 0;;)
+	{
+		size_t largest = pos;
+
+		for (size_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < pg->count; child++)
+			if (page_after(pg, child, largest))
+				largest = child;
+
+		if (largest == pos)
+			break;
+
+		page_swap(pg, pos, largest);
+		pos = largest;
+	}
+}
+
+// Offers the members of an AUDIT set sorting after the NEXT key, skipping those already offered from the other set
+static void collect_set(struct audit_page *pg, const enum project_audit_set set, const unsigned int skip_sets, const char *after)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, projectsvs->audit_sets[set].head)
+	{
+		struct projectns *project = n->data;
+
+		if (project->audit_sets & skip_sets)
+			continue;
+		if (after && strcasecmp(project->name, after) <= 0)
+			continue;
+
+		page_offer(pg, project);
+	}
+}
+
+static void cmd_audit_count(sourceinfo_t *si)
+{
+	const size_t no_channels = projectsvs->audit_sets[PROJECT_AUDIT_NO_CHANNELS].count;
+	const size_t no_contacts = projectsvs->audit_sets[PROJECT_AUDIT_NO_CONTACTS].count;
+
+	command_success_nodata(si, _("Projects without channel namespaces: \2%zu\2"), no_channels);
+	command_success_nodata(si, _("Projects without contacts: \2%zu\2"), no_contacts);
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:AUDIT:COUNT: \2%zu\2/\2%zu\2", no_channels, no_contacts);
+}
+
 static void cmd_audit(sourceinfo_t *si, int parc, char *parv[])
 {
 	bool check_channels = false;
 	bool check_contacts = false;
+	struct page_options opts;
 
 	const char *what = "";
+	const char *kind = "";
+	int first_option = 1;
+
+	if (parc == 1 && strcasecmp(parv[0], "COUNT") == 0)
+	{
+		cmd_audit_count(si);
+		return;
+	}
 
-	if (parc == 0)
+	if (parc == 0 || strcasecmp(parv[0], "LIMIT") == 0 || strcasecmp(parv[0], "NEXT") == 0)
 	{
 		check_channels = check_contacts = true;
+		first_option = 0;
 	}
 	else if (strcasecmp(parv[0], "CHANNELS") == 0)
 	{
 		check_channels = true;
 		what = "CHANNELS:";
+		kind = " CHANNELS";
 	}
 	else if (strcasecmp(parv[0], "CONTACTS") == 0)
 	{
 		check_contacts = true;
 		what = "CONTACTS:";
+		kind = " CONTACTS";
 	}
 	else
+	{
+		first_option = -1;
+	}
+
+	if (first_option < 0 || !projectsvs->parse_page_options(parc - first_option, parv + first_option, &opts))
 	{
 		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "AUDIT");
-		command_fail(si, fault_badparams, _("Syntax: AUDIT [CHANNELS|CONTACTS]"));
+		command_fail(si, fault_badparams, _("Syntax: AUDIT [CHANNELS|CONTACTS] [LIMIT <n>] [NEXT <project>]"));
+		command_fail(si, fault_badparams, _("Syntax: AUDIT COUNT"));
 		return;
 	}
 
-	mowgli_patricia_iteration_state_t state;
-	struct projectns *project;
-	unsigned int matches = 0;
+	/* The sets only hold projects that need attention, so this costs as much
+	 * as the results do. They are unordered; keep the first page by name so
+	 * that NEXT can resume from it.
+	 */
+	const size_t no_channels = projectsvs->audit_sets[PROJECT_AUDIT_NO_CHANNELS].count;
+	const size_t no_contacts = projectsvs->audit_sets[PROJECT_AUDIT_NO_CONTACTS].count;
+	size_t max = 0;
 
-	command_success_nodata(si, _("Projects in need of attention:"));
+	if (check_channels)
+		max += no_channels;
+	if (check_contacts)
+		max += no_contacts;
 
-	MOWGLI_PATRICIA_FOREACH(project, &state, projectsvs->projects)
-	{
-		char channels[BUFSIZE] = "";
-		mowgli_node_t *n;
-		MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
-		{
-			if (channels[0])
-				mowgli_strlcat(channels, ", ", sizeof channels);
-			mowgli_strlcat(channels, (const char*)n->data, sizeof channels);
-		}
+	struct audit_page page = { .size = opts.limit && opts.limit < max ? opts.limit : max };
+	page.heap = smalloc((page.size ? page.size : 1) * sizeof *page.heap);
 
-		char contacts[BUFSIZE] = "";
-		MOWGLI_ITER_FOREACH(n, project->contacts.head)
-		{
-			struct project_contact *contact = n->data;
-			if (contacts[0])
-				mowgli_strlcat(contacts, ", ", sizeof contacts);
-			mowgli_strlcat(contacts, ((myentity_t*)contact->mu)->name, sizeof contacts);
-		}
+	if (check_channels)
+		collect_set(&page, PROJECT_AUDIT_NO_CHANNELS, 0, opts.after);
+	if (check_contacts)
+		collect_set(&page, PROJECT_AUDIT_NO_CONTACTS,
+		            check_channels ? 1U << PROJECT_AUDIT_NO_CHANNELS : 0, opts.after);
 
-		if ((check_channels && !channels[0]) || (check_contacts && !contacts[0]))
-		{
-			matches++;
-			command_success_nodata(si, _("- %s (%s; %s)"), project->name,
-			                           (channels[0] ? channels : _("\2no channels\2")),
-			                           (contacts[0] ? contacts : _("\2no contacts\2")));
-		}
-	}
+	qsort(page.heap, page.count, sizeof *page.heap, project_name_cmp);
+
+	const unsigned int matches = page.count;
+
+	command_success_nodata(si, _("Projects in need of attention:"));
 
-	if (matches == 0)
+	for (unsigned int i = 0; i < matches; i++)
+		show_project(si, page.heap[i]);
+
+	if (matches == 0 && !opts.after)
 		command_success_nodata(si, _("All projects correctly registered."));
+	else if (matches < page.candidates)
+		command_success_nodata(si, ngettext(N_("\2%d\2 project shown."), N_("\2%d\2 projects shown."), matches), matches);
+	else
+		command_success_nodata(si, ngettext(N_("\2%d\2 project listed."), N_("\2%d\2 projects listed."), matches), matches);
+
+	if (check_channels && check_contacts)
+		command_success_nodata(si, _("In total, \2%zu\2 projects have no channel namespaces and \2%zu\2 have no contacts."),
+		                       no_channels, no_contacts);
 	else
-		command_success_nodata(si, ngettext(N_("\2%d\2 project in need of attention."),
-		                                    N_("\2%d\2 projects in need of attention."),
-		                                    matches), matches);
+		command_success_nodata(si, ngettext(N_("In total, \2%zu\2 project is in need of attention."),
+		                                    N_("In total, \2%zu\2 projects are in need of attention."),
+		                                    max), max);
+
+	if (matches < page.candidates)
+		command_success_nodata(si, _("More projects need attention; continue with \2AUDIT%s LIMIT %u NEXT %s\2"), kind, opts.limit, page.heap[matches - 1]->name);
 	logcommand(si, CMDLOG_ADMIN, "PROJECT:AUDIT:%s \2%d\2 projects", what, matches);
+
+	free(page.heap);
 }
 
 static void mod_init(module_t *const restrict m)
@@ -76,7 +76,8 @@ static void cmd_channel(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	struct projectns *chan_p = mowgli_patricia_retrieve(projectsvs->projects_by_channelns, namespace);
+	struct project_namespace *ns = projectsvs->channelns_find(namespace);
+	struct projectns *chan_p = ns ? ns->project : NULL;
 	if (chan_p && add_or_del == CHANNS_ADD)
 	{
 		command_fail(si, fault_alreadyexists, _("The \2%s\2 namespace already belongs to project \2%s\2."), namespace, chan_p->name);
@@ -96,22 +97,7 @@ static void cmd_channel(sourceinfo_t *si, int parc, char *parv[])
 			return;
 		}
 
-		mowgli_patricia_delete(projectsvs->projects_by_channelns, namespace);
-
-		mowgli_node_t *n, *tn;
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, chan_p->channel_ns.head)
-		{
-			const char *ns = n->data;
-			if (irccasecmp(ns, namespace) == 0)
-			{
-				free(n->data);
-
-				mowgli_node_delete(n, &chan_p->channel_ns);
-				mowgli_node_free(n);
-
-				break;
-			}
-		}
+		projectsvs->channelns_del(chan_p, namespace);
 
 		logcommand(si, CMDLOG_ADMIN, "PROJECT:CHANNEL:DEL: \2%s\2 from \2%s\2", namespace, chan_p->name);
 		command_success_nodata(si, _("The namespace \2%s\2 was unregistered from project \2%s\2."), namespace, chan_p->name);
@@ -119,8 +105,7 @@ static void cmd_channel(sourceinfo_t *si, int parc, char *parv[])
 	else // CHANNS_ADD
 	{
 		/* We've checked above that this namespace isn't already registered */
-		mowgli_patricia_add(projectsvs->projects_by_channelns, namespace, p);
-		mowgli_node_add(sstrdup(namespace), mowgli_node_create(), &p->channel_ns);
+		projectsvs->channelns_add(p, namespace);
 
 		logcommand(si, CMDLOG_ADMIN, "PROJECT:CHANNEL:ADD: \2%s\2 to \2%s\2", namespace, p->name);
 		command_success_nodata(si, _("The namespace \2%s\2 was registered to project \2%s\2."), namespace, p->name);
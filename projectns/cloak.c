@@ -85,7 +85,8 @@ static void cmd_cloak(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	struct projectns *cloak_p = mowgli_patricia_retrieve(projectsvs->projects_by_cloakns, namespace);
+	struct project_namespace *ns = projectsvs->cloakns_find(namespace);
+	struct projectns *cloak_p = ns ? ns->project : NULL;
 	if (cloak_p && add_or_del == CLOAKNS_ADD)
 	{
 		command_fail(si, fault_alreadyexists, _("The \2%s\2 namespace already belongs to project \2%s\2."), namespace, cloak_p->name);
@@ -105,22 +106,7 @@ static void cmd_cloak(sourceinfo_t *si, int parc, char *parv[])
 			return;
 		}
 
-		mowgli_patricia_delete(projectsvs->projects_by_cloakns, namespace);
-
-		mowgli_node_t *n, *tn;
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, p->cloak_ns.head)
-		{
-			const char *ns = n->data;
-			if (irccasecmp(ns, namespace) == 0)
-			{
-				free(n->data);
-
-				mowgli_node_delete(n, &p->cloak_ns);
-				mowgli_node_free(n);
-
-				break;
-			}
-		}
+		projectsvs->cloakns_del(p, namespace);
 
 		logcommand(si, CMDLOG_ADMIN, "PROJECT:CLOAK:DEL: \2%s\2 from \2%s\2", namespace, p->name);
 		command_success_nodata(si, _("The namespace \2%s\2 was unregistered from project \2%s\2."), namespace, p->name);
@@ -128,8 +114,7 @@ static void cmd_cloak(sourceinfo_t *si, int parc, char *parv[])
 	else // CLOAKNS_ADD
 	{
 		/* We've checked above that this namespace isn't already registered */
-		mowgli_patricia_add(projectsvs->projects_by_cloakns, namespace, p);
-		mowgli_node_add(sstrdup(namespace), mowgli_node_create(), &p->cloak_ns);
+		projectsvs->cloakns_add(p, namespace);
 
 		logcommand(si, CMDLOG_ADMIN, "PROJECT:CLOAK:ADD: \2%s\2 to \2%s\2", namespace, p->name);
 		command_success_nodata(si, _("The namespace \2%s\2 was registered to project \2%s\2."), namespace, p->name);
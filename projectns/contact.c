@@ -135,16 +135,9 @@ static void cmd_contact(sourceinfo_t *si, int parc, char *parv[])
 	}
 	else if (add_or_del == CONTACT_SET)
 	{
-		mowgli_node_t *n;
-		struct project_contact *c;
-		MOWGLI_ITER_FOREACH(n, p->contacts.head)
-		{
-			c = n->data;
-			if (c->mu == mu)
-				break;
-		}
+		struct project_contact *c = projectsvs->contact_find(p, mu);
 
-		if (!n)
+		if (!c)
 		{
 			command_fail(si, fault_nosuch_key, _("\2%s\2 was not listed as a contact for project \2%s\2."), entity(mu)->name, p->name);
 		}
@@ -180,7 +173,9 @@ static void cmd_contact(sourceinfo_t *si, int parc, char *parv[])
 				command_success_nodata(si, _("\2%s\2 is now considered a primary contact for project \2%s\2."), entity(mu)->name, p->name);
 			}
 
-			if (!change_visible && !change_secondary)
+			if (change_visible || change_secondary)
+				projectsvs->project_touch(p);
+			else
 				command_fail(si, fault_nochange, _("Settings for \2%s\2 as a contact for project \2%s\2 were not changed."), entity(mu)->name, p->name);
 		}
 	}
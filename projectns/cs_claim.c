@@ -25,39 +25,20 @@ static void cmd_claim(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	char *namespace = NULL;
-	struct projectns *p = projectsvs->channame_get_project(name, &namespace);
+	char namespace[CHANNELLEN];
+	struct projectns *p = projectsvs->channame_get_project(name, namespace, sizeof namespace);
 
 	if (!p)
 	{
 		command_fail(si, fault_noprivs, _("\2%s\2 does not belong to any registered project."), name);
-		free(namespace);
 		return;
 	}
-	else
+	else if (!projectsvs->is_contact(p, si->smu))
 	{
-		mowgli_node_t *n;
-		bool is_gc = false;
-		MOWGLI_ITER_FOREACH(n, p->contacts.head)
-		{
-			struct project_contact *contact = n->data;
-			if (si->smu == contact->mu)
-			{
-				is_gc = true;
-				break;
-			}
-		}
-
-		if (!is_gc)
-		{
-			command_fail(si, fault_noprivs, _("You are not an authorized group contact for the \2%s\2 namespace."), namespace);
-			free(namespace);
-			return;
-		}
+		command_fail(si, fault_noprivs, _("You are not an authorized group contact for the \2%s\2 namespace."), namespace);
+		return;
 	}
 
-	free(namespace);
-
 	mychan_t *mc = mychan_find(name);
 
 	unsigned int founder_flags = flags_to_bitmask(chansvs.founder_flags, 0);
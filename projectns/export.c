@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Command to export the registry as JSON
+ */
+
+#include "fn-compat.h"
+#include "atheme.h"
+#include "projectns.h"
+
+static void cmd_export(sourceinfo_t *si, int parc, char *parv[]);
+
+static command_t ps_export = { "EXPORT", N_("Exports project registrations as JSON."), PRIV_PROJECT_ADMIN, 1, cmd_export, { .path = "freenode/project_export" } };
+
+static void cmd_export(sourceinfo_t *si, int parc, char *parv[])
+{
+	char *filename = parv[0];
+
+	if (!filename)
+	{
+		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "EXPORT");
+		command_fail(si, fault_needmoreparams, _("Syntax: EXPORT <file>"));
+		return;
+	}
+
+	if (!projectsvs->is_valid_data_file_name(filename, PROJECT_EXPORT_SUFFIX))
+	{
+		command_fail(si, fault_badparams, _("\2%s\2 is not a valid file name. Exports can only be written to \2*%s\2 files."),
+		             filename, PROJECT_EXPORT_SUFFIX);
+		return;
+	}
+
+	if (projectsvs->export_running())
+	{
+		command_fail(si, fault_toomany, _("An export is already running. Please try again later."));
+		return;
+	}
+
+	if (!projectsvs->export_start(filename, get_oper_name(si)))
+	{
+		command_fail(si, fault_internalerror, _("Could not create \2%s\2: %s"), filename, strerror(errno));
+		return;
+	}
+
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:EXPORT: \2%s\2", filename);
+	command_success_nodata(si, _("Exporting projects to \2%s\2. The result will be logged once it has finished."), filename);
+}
+
+static void mod_init(module_t *const restrict m)
+{
+	if (!use_projectns_main_symbols(m))
+		return;
+	service_named_bind_command("projectserv", &ps_export);
+}
+
+static void mod_deinit(const module_unload_intent_t unused)
+{
+	service_named_unbind_command("projectserv", &ps_export);
+}
+
+DECLARE_MODULE_V1
+(
+	"freenode/projectns/export", MODULE_UNLOAD_CAPABILITY_OK, mod_init, mod_deinit,
+	"", "freenode <http://www.freenode.net>"
+);
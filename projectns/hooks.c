@@ -14,8 +14,47 @@ static bool register_require_namespace;
 static char *register_require_namespace_exempt;
 static char *register_project_advice;
 
+// REGISTER_REQUIRE_NAMESPACE_EXEMPT, compiled whenever the configuration is (re)loaded
+static struct compiled_glob *namespace_exempt_glob;
+
+static void compile_namespace_exempt(void *unused)
+{
+	projectsvs->glob_free(namespace_exempt_glob);
+	namespace_exempt_glob = NULL;
+
+	if (register_require_namespace_exempt)
+		namespace_exempt_glob = projectsvs->glob_compile(register_require_namespace_exempt);
+}
+
+// Copies a cached render chunk, spelling out its annotations in the viewer's language
+static const char *render_chunk_text(const char *chunk, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	for (; *chunk && len + 1 < size; chunk++)
+	{
+		const char *text = NULL;
+
+		if (*chunk == PROJECT_RENDER_MARKED)
+			text = _("\2MARKED\2");
+		else if (*chunk == PROJECT_RENDER_SECONDARY)
+			text = _(" (secondary)");
+
+		if (!text)
+			buf[len++] = *chunk;
+		else if ((len += mowgli_strlcpy(buf + len, text, size - len)) >= size)
+			len = size - 1;
+	}
+
+	buf[len] = '\0';
+	return buf;
+}
+
 static void userinfo_hook(hook_user_req_t *hdata)
 {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	bool priv = has_priv(hdata->si, PRIV_PROJECT_AUSPEX);
 
 	if (hdata->si->smu == hdata->mu || priv)
@@ -56,80 +95,28 @@ static void userinfo_hook(hook_user_req_t *hdata)
 				}
 			}
 
-			mowgli_node_t *n2;
-			char buf[BUFSIZE] = "";
-
-			bool channels_need_separator = false;
-
-			if (priv && project->marks.head != NULL)
-			{
-				mowgli_strlcpy(buf, _("\2MARKED\2"), sizeof buf);
-				channels_need_separator = true;
-			}
-
-			bool cloaks_need_separator = channels_need_separator;
-			MOWGLI_ITER_FOREACH(n2, project->channel_ns.head)
-			{
-				if (strlen(buf) > 80)
-				{
-					command_success_nodata(hdata->si, format, project->name, buf);
-					buf[0] = '\0';
-					channels_need_separator = false;
-				}
-				if (buf[0])
-				{
-					if (channels_need_separator)
-					{
-						mowgli_strlcat(buf, "; ", sizeof buf);
-						channels_need_separator = false;
-					}
-					else
-					{
-						mowgli_strlcat(buf, ", ", sizeof buf);
-					}
-				}
-				mowgli_strlcat(buf, (const char*)n2->data, sizeof buf);
-				cloaks_need_separator = true;
-			}
-
-			MOWGLI_ITER_FOREACH(n2, project->cloak_ns.head)
-			{
-				if (strlen(buf) > 80)
-				{
-					command_success_nodata(hdata->si, format, project->name, buf);
-					buf[0] = '\0';
-					cloaks_need_separator = false;
-				}
-				if (buf[0])
-				{
-					if (cloaks_need_separator)
-					{
-						mowgli_strlcat(buf, "; ", sizeof buf);
-						cloaks_need_separator = false;
-					}
-					else
-					{
-						mowgli_strlcat(buf, ", ", sizeof buf);
-					}
-				}
+			const struct project_render *r = projectsvs->project_render(project, priv ? PROJECT_RENDER_USERINFO_PRIV : PROJECT_RENDER_USERINFO);
+			const struct project_render_section *s = &r->sections[0];
 
-				char ns[BUFSIZE];
-				snprintf(ns, sizeof ns, "%s/*", (const char*)n2->data);
-				mowgli_strlcat(buf, ns, sizeof buf);
-			}
+			char buf[BUFSIZE];
 
-			if (buf[0])
-				command_success_nodata(hdata->si, format, project->name, buf);
-			else
+			for (unsigned int i = 0; i < s->nchunks; i++)
+				command_success_nodata(hdata->si, format, project->name, render_chunk_text(s->chunks[i], buf, sizeof buf));
+			if (!s->nchunks)
 				command_success_nodata(hdata->si, format_empty, project->name);
 		}
 	}
+
+	hook_latency_record(PROJECTNS_HOOK_USERINFO, &start);
 }
 
 static void chaninfo_hook(hook_channel_req_t *hdata)
 {
-	char *namespace = NULL;
-	struct projectns *p = projectsvs->channame_get_project(hdata->mc->name, &namespace);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	char namespace[CHANNELLEN];
+	struct projectns *p = projectsvs->channame_get_project(hdata->mc->name, namespace, sizeof namespace);
 
 	bool priv = has_priv(hdata->si, PRIV_PROJECT_AUSPEX);
 
@@ -141,67 +128,35 @@ static void chaninfo_hook(hook_channel_req_t *hdata)
 		else
 			command_success_nodata(hdata->si, _("The \2%s\2 namespace is registered to the \2%s\2 project"), namespace, p->name);
 
-		char buf[BUFSIZE] = "";
+		const struct project_render *r = projectsvs->project_render(p, priv ? PROJECT_RENDER_CHANINFO_PRIV : PROJECT_RENDER_CHANINFO);
+		const struct project_render_section *s = &r->sections[PROJECT_RENDER_CHANINFO_PUBLIC];
 
-		mowgli_node_t *n;
-		MOWGLI_ITER_FOREACH(n, p->contacts.head)
-		{
-			struct project_contact *c = n->data;
-			if (!c->visible)
-				continue;
+		char buf[BUFSIZE];
 
-			if (strlen(buf) > 80)
-			{
-				command_success_nodata(hdata->si, _("Public contacts: %s"), buf);
-				buf[0] = '\0';
-			}
-			if (buf[0])
-				mowgli_strlcat(buf, ", ", sizeof buf);
-			mowgli_strlcat(buf, entity(c->mu)->name, sizeof buf);
-
-			if (priv && c->secondary)
-				mowgli_strlcat(buf, _(" (secondary)"), sizeof buf);
-		}
-
-		if (buf[0])
-			command_success_nodata(hdata->si, _("Public contacts: %s"), buf);
+		for (unsigned int i = 0; i < s->nchunks; i++)
+			command_success_nodata(hdata->si, _("Public contacts: %s"), render_chunk_text(s->chunks[i], buf, sizeof buf));
 
 		if (priv)
 		{
-			buf[0] = '\0';
-			MOWGLI_ITER_FOREACH(n, p->contacts.head)
-			{
-				struct project_contact *c = n->data;
-				if (c->visible)
-					continue;
-
-				if (strlen(buf) > 80)
-				{
-					command_success_nodata(hdata->si, _("Unlisted contacts: %s"), buf);
-					buf[0] = '\0';
-				}
-				if (buf[0])
-					mowgli_strlcat(buf, ", ", sizeof buf);
-				mowgli_strlcat(buf, entity(c->mu)->name, sizeof buf);
-
-				if (priv && c->secondary)
-					mowgli_strlcat(buf, _(" (secondary)"), sizeof buf);
-			}
+			s = &r->sections[PROJECT_RENDER_CHANINFO_UNLISTED];
 
-			if (buf[0])
-				command_success_nodata(hdata->si, _("Unlisted contacts: %s"), buf);
+			for (unsigned int i = 0; i < s->nchunks; i++)
+				command_success_nodata(hdata->si, _("Unlisted contacts: %s"), render_chunk_text(s->chunks[i], buf, sizeof buf));
 		}
 	}
 
-	free(namespace);
+	hook_latency_record(PROJECTNS_HOOK_CHANINFO, &start);
 }
 
 static void try_register_hook(hook_channel_register_check_t *hdata)
 {
-	char *namespace = NULL;
-	struct projectns *project = projectsvs->channame_get_project(hdata->name, &namespace);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
-	if (register_require_namespace && !project && match(register_require_namespace_exempt, hdata->name))
+	char namespace[CHANNELLEN];
+	struct projectns *project = projectsvs->channame_get_project(hdata->name, namespace, sizeof namespace);
+
+	if (register_require_namespace && !project && !(namespace_exempt_glob && projectsvs->glob_match(namespace_exempt_glob, hdata->name)))
 	{
 		hdata->approved = 1;
 		command_fail(hdata->si, fault_noprivs, _("The given channel name is not registered to any project, so you cannot use it."));
@@ -210,19 +165,7 @@ static void try_register_hook(hook_channel_register_check_t *hdata)
 	}
 	else if (project && !project->any_may_register)
 	{
-		mowgli_node_t *n;
-		bool is_gc = false;
-		MOWGLI_ITER_FOREACH(n, project->contacts.head)
-		{
-			struct project_contact *contact = n->data;
-			if (hdata->si->smu == contact->mu)
-			{
-				is_gc = true;
-				break;
-			}
-		}
-
-		if (!is_gc)
+		if (!projectsvs->is_contact(project, hdata->si->smu))
 		{
 			hdata->approved = 1;
 			command_fail(hdata->si, fault_noprivs, _("The \2%s\2 namespace is registered to the \2%s\2 project, so only authorized contacts may register new channels."), namespace, project->name);
@@ -231,13 +174,16 @@ static void try_register_hook(hook_channel_register_check_t *hdata)
 		}
 	}
 
-	free(namespace);
+	hook_latency_record(PROJECTNS_HOOK_TRY_REGISTER, &start);
 }
 
 static void did_register_hook(hook_channel_req_t *hdata)
 {
-	char *namespace = NULL;
-	struct projectns *project = projectsvs->channame_get_project(hdata->mc->name, &namespace);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	char namespace[CHANNELLEN];
+	struct projectns *project = projectsvs->channame_get_project(hdata->mc->name, namespace, sizeof namespace);
 
 	if (project)
 	{
@@ -246,7 +192,7 @@ static void did_register_hook(hook_channel_req_t *hdata)
 			command_success_nodata(hdata->si, _("See %s for more information."), project->reginfo);
 	}
 
-	free(namespace);
+	hook_latency_record(PROJECTNS_HOOK_DID_REGISTER, &start);
 }
 
 static void mod_init(module_t *const restrict m)
@@ -262,6 +208,9 @@ static void mod_init(module_t *const restrict m)
 	add_bool_conf_item("REGISTER_REQUIRE_NAMESPACE", &projectsvs->me->conf_table, 0, &register_require_namespace, false);
 	add_dupstr_conf_item("REGISTER_REQUIRE_NAMESPACE_EXEMPT", &projectsvs->me->conf_table, 0, &register_require_namespace_exempt, NULL);
 	add_dupstr_conf_item("REGISTER_PROJECT_ADVICE", &projectsvs->me->conf_table, 0, &register_project_advice, NULL);
+
+	compile_namespace_exempt(NULL);
+	hook_add_config_ready(compile_namespace_exempt);
 }
 
 static void mod_deinit(const module_unload_intent_t unused)
@@ -270,6 +219,10 @@ static void mod_deinit(const module_unload_intent_t unused)
 	hook_del_channel_info(chaninfo_hook);
 	hook_del_channel_can_register(try_register_hook);
 	hook_del_channel_register(did_register_hook);
+	hook_del_config_ready(compile_namespace_exempt);
+
+	projectsvs->glob_free(namespace_exempt_glob);
+	namespace_exempt_glob = NULL;
 
 	del_conf_item("REGISTER_REQUIRE_NAMESPACE", &projectsvs->me->conf_table);
 	del_conf_item("REGISTER_REQUIRE_NAMESPACE_EXEMPT", &projectsvs->me->conf_table);
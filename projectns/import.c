@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Command to register projects in bulk from a file
+ */
+
+#include "fn-compat.h"
+#include "atheme.h"
+#include "projectns.h"
+
+/* Import files live in the data directory and contain one directive per line:
+ *
+ *   PROJECT <name>
+ *   CHANNEL <#namespace>
+ *   CLOAK <namespace>
+ *   CONTACT <account> [PUBLIC|PRIVATE] [PRIMARY|SECONDARY]
+ *
+ * CHANNEL, CLOAK and CONTACT apply to the most recent PROJECT. Blank lines and
+ * lines starting with '#' are ignored. The whole file is checked before anything
+ * is changed, and a file with any error is not applied at all.
+ */
+
+#define IMPORT_MAX_ERRORS 20
+#define IMPORT_SUFFIX     ".txt"
+
+static void cmd_import(sourceinfo_t *si, int parc, char *parv[]);
+
+static command_t ps_import = { "IMPORT", N_("Registers projects in bulk from a file."), PRIV_PROJECT_ADMIN, 1, cmd_import, { .path = "freenode/project_import" } };
+
+struct import_contact {
+	myuser_t *mu;
+	bool visible;
+	bool secondary;
+	mowgli_node_t n;
+};
+
+struct import_project {
+	char *name;
+	mowgli_list_t channels;
+	mowgli_list_t cloaks;
+	mowgli_list_t contacts;
+	mowgli_node_t n;
+};
+
+struct import_batch {
+	sourceinfo_t *si;
+	const char *filename;
+	mowgli_list_t projects;
+
+	// everything claimed so far, to catch duplicates within the file
+	mowgli_patricia_t *names;
+	mowgli_patricia_t *channels;
+	mowgli_patricia_t *cloaks;
+
+	unsigned int errors;
+	unsigned int nchannels;
+	unsigned int ncloaks;
+	unsigned int ncontacts;
+};
+
+static void import_error(struct import_batch *b, unsigned int line, const char *fmt, ...)
+{
+	char buf[BUFSIZE];
+	va_list va;
+
+	if (++b->errors > IMPORT_MAX_ERRORS)
+		return;
+
+	va_start(va, fmt);
+	vsnprintf(buf, sizeof buf, fmt, va);
+	va_end(va);
+
+	command_fail(b->si, fault_badparams, _("%s line %u: %s"), b->filename, line, buf);
+}
+
+static void free_string_list(mowgli_list_t *l)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+	{
+		free(n->data);
+		mowgli_node_delete(n, l);
+		mowgli_node_free(n);
+	}
+}
+
+static void batch_free(struct import_batch *b)
+{
+	mowgli_node_t *n, *tn, *cn, *ctn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, b->projects.head)
+	{
+		struct import_project *ip = n->data;
+
+		free_string_list(&ip->channels);
+		free_string_list(&ip->cloaks);
+		MOWGLI_ITER_FOREACH_SAFE(cn, ctn, ip->contacts.head)
+			free(cn->data);
+
+		free(ip->name);
+		free(ip);
+	}
+
+	mowgli_patricia_destroy(b->names, NULL, NULL);
+	mowgli_patricia_destroy(b->channels, NULL, NULL);
+	mowgli_patricia_destroy(b->cloaks, NULL, NULL);
+}
+
+static bool printable(const char *s)
+{
+	for (; *s; s++)
+		if (!isprint((unsigned char)*s))
+			return false;
+
+	return true;
+}
+
+// Same checks as REGISTER
+static void parse_project(struct import_batch *b, unsigned int line, char *name)
+{
+	if (!projectsvs->is_valid_project_name(name))
+	{
+		import_error(b, line, _("\2%s\2 is not a valid project name."), name);
+		return;
+	}
+	if (projectsvs->project_find(name))
+	{
+		import_error(b, line, _("\2%s\2 is already registered."), name);
+		return;
+	}
+	if (mowgli_patricia_retrieve(b->names, name))
+	{
+		import_error(b, line, _("\2%s\2 is listed more than once."), name);
+		return;
+	}
+
+	struct import_project *ip = scalloc(1, sizeof *ip);
+	ip->name = sstrdup(name);
+	mowgli_node_add(ip, &ip->n, &b->projects);
+	mowgli_patricia_add(b->names, ip->name, ip);
+}
+
+// Same checks as CHANNEL ADD
+static void parse_channel(struct import_batch *b, unsigned int line, struct import_project *ip, char *ns)
+{
+	if (!printable(ns))
+	{
+		import_error(b, line, _("The channel name contains invalid characters."));
+		return;
+	}
+	if (ns[0] != '#' || strlen(ns) >= CHANNELLEN)
+	{
+		import_error(b, line, _("\2%s\2 is not a valid channel name."), ns);
+		return;
+	}
+
+	struct project_namespace *existing = projectsvs->channelns_find(ns);
+	if (existing)
+	{
+		import_error(b, line, _("The \2%s\2 namespace already belongs to project \2%s\2."), ns, existing->project->name);
+		return;
+	}
+
+	struct import_project *other = mowgli_patricia_retrieve(b->channels, ns);
+	if (other)
+	{
+		import_error(b, line, _("The \2%s\2 namespace is already listed for project \2%s\2."), ns, other->name);
+		return;
+	}
+
+	char *copy = sstrdup(ns);
+	mowgli_node_add(copy, mowgli_node_create(), &ip->channels);
+	mowgli_patricia_add(b->channels, copy, ip);
+	b->nchannels++;
+}
+
+// Same checks as CLOAK ADD
+static void parse_cloak(struct import_batch *b, unsigned int line, struct import_project *ip, char *ns)
+{
+	for (size_t i = strlen(ns) - 1; i > 0; i--)
+	{
+		if (ns[i] != '/' && ns[i] != '*')
+			break;
+
+		ns[i] = '\0';
+	}
+
+	if (strlen(ns) >= HOSTLEN)
+	{
+		import_error(b, line, _("The cloak namespace is too long."));
+		return;
+	}
+	if (!printable(ns))
+	{
+		import_error(b, line, _("The cloak namespace contains invalid characters."));
+		return;
+	}
+
+	struct project_namespace *existing = projectsvs->cloakns_find(ns);
+	if (existing)
+	{
+		import_error(b, line, _("The \2%s\2 namespace already belongs to project \2%s\2."), ns, existing->project->name);
+		return;
+	}
+
+	struct import_project *other = mowgli_patricia_retrieve(b->cloaks, ns);
+	if (other)
+	{
+		import_error(b, line, _("The \2%s\2 namespace is already listed for project \2%s\2."), ns, other->name);
+		return;
+	}
+
+	char *copy = sstrdup(ns);
+	mowgli_node_add(copy, mowgli_node_create(), &ip->cloaks);
+	mowgli_patricia_add(b->cloaks, copy, ip);
+	b->ncloaks++;
+}
+
+// Same checks and flags as CONTACT ADD
+static void parse_contact(struct import_batch *b, unsigned int line, struct import_project *ip, char *account, char *saveptr)
+{
+	bool visible = false, secondary = false;
+	bool visible_set = false, secondary_set = false;
+	char *flag;
+
+	while ((flag = strtok_r(NULL, " \t", &saveptr)))
+	{
+		if ((strcasecmp(flag, "PUBLIC") == 0 || strcasecmp(flag, "PRIVATE") == 0) && !visible_set)
+		{
+			visible = strcasecmp(flag, "PUBLIC") == 0;
+			visible_set = true;
+		}
+		else if ((strcasecmp(flag, "PRIMARY") == 0 || strcasecmp(flag, "SECONDARY") == 0) && !secondary_set)
+		{
+			secondary = strcasecmp(flag, "SECONDARY") == 0;
+			secondary_set = true;
+		}
+		else
+		{
+			import_error(b, line, _("Unknown or repeated contact flag \2%s\2."), flag);
+			return;
+		}
+	}
+
+	myuser_t *mu = myuser_find_ext(account);
+	if (!mu)
+	{
+		import_error(b, line, _("\2%s\2 is not registered."), account);
+		return;
+	}
+
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, ip->contacts.head)
+	{
+		struct import_contact *ic = n->data;
+		if (ic->mu == mu)
+		{
+			import_error(b, line, _("\2%s\2 is already listed as contact for project \2%s\2."), entity(mu)->name, ip->name);
+			return;
+		}
+	}
+
+	struct import_contact *ic = smalloc(sizeof *ic);
+	ic->mu        = mu;
+	ic->visible   = visible;
+	ic->secondary = secondary;
+	mowgli_node_add(ic, &ic->n, &ip->contacts);
+	b->ncontacts++;
+}
+
+static bool parse_file(struct import_batch *b, FILE *f)
+{
+	char line[BUFSIZE];
+	unsigned int lineno = 0;
+	struct import_project *current = NULL;
+	bool bad_project = false;
+
+	while (fgets(line, sizeof line, f))
+	{
+		lineno++;
+
+		size_t len = strlen(line);
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		else if (!feof(f))
+		{
+			import_error(b, lineno, _("Line too long."));
+			// skip the rest of it
+			int c;
+			while ((c = fgetc(f)) != EOF && c != '\n')
+				;
+			continue;
+		}
+		if (len && line[len - 1] == '\r')
+			line[--len] = '\0';
+
+		char *saveptr;
+		char *directive = strtok_r(line, " \t", &saveptr);
+
+		if (!directive || directive[0] == '#')
+			continue;
+
+		char *arg = strtok_r(NULL, " \t", &saveptr);
+		if (!arg)
+		{
+			import_error(b, lineno, _("\2%s\2 needs a parameter."), directive);
+			continue;
+		}
+
+		if (strcasecmp(directive, "PROJECT") == 0)
+		{
+			const unsigned int before = b->errors;
+
+			if (strtok_r(NULL, " \t", &saveptr))
+				import_error(b, lineno, _("Project names cannot contain spaces."));
+			else
+				parse_project(b, lineno, arg);
+
+			// keep checking what follows, but against nothing
+			bad_project = b->errors != before;
+			current = bad_project ? NULL : b->projects.tail->data;
+			continue;
+		}
+
+		if (strcasecmp(directive, "CHANNEL") != 0 && strcasecmp(directive, "CLOAK") != 0 && strcasecmp(directive, "CONTACT") != 0)
+		{
+			import_error(b, lineno, _("Unknown directive \2%s\2."), directive);
+			continue;
+		}
+
+		if (!current)
+		{
+			// an invalid PROJECT line was already reported
+			if (!bad_project)
+				import_error(b, lineno, _("\2%s\2 must follow a PROJECT line."), directive);
+			continue;
+		}
+
+		if (strcasecmp(directive, "CONTACT") == 0)
+		{
+			parse_contact(b, lineno, current, arg, saveptr);
+			continue;
+		}
+
+		if (strtok_r(NULL, " \t", &saveptr))
+		{
+			import_error(b, lineno, _("Too many parameters for \2%s\2."), directive);
+			continue;
+		}
+
+		if (strcasecmp(directive, "CHANNEL") == 0)
+			parse_channel(b, lineno, current, arg);
+		else
+			parse_cloak(b, lineno, current, arg);
+	}
+
+	if (ferror(f))
+	{
+		command_fail(b->si, fault_badparams, _("Error reading \2%s\2."), b->filename);
+		return false;
+	}
+
+	return b->errors == 0;
+}
+
+// Everything was checked while parsing, so none of this can fail
+static void apply_batch(struct import_batch *b)
+{
+	const char *oper = get_storage_oper_name(b->si);
+	mowgli_node_t *n, *sn;
+
+	MOWGLI_ITER_FOREACH(n, b->projects.head)
+	{
+		struct import_project *ip = n->data;
+		struct projectns *p = projectsvs->project_new(ip->name);
+
+		projectsvs->project_set_creation(p, CURRTIME, oper);
+
+		MOWGLI_ITER_FOREACH(sn, ip->channels.head)
+			projectsvs->channelns_add(p, sn->data);
+
+		MOWGLI_ITER_FOREACH(sn, ip->cloaks.head)
+			projectsvs->cloakns_add(p, sn->data);
+
+		MOWGLI_ITER_FOREACH(sn, ip->contacts.head)
+		{
+			struct import_contact *ic = sn->data;
+			struct project_contact *c = projectsvs->contact_new(p, ic->mu);
+
+			c->visible   = ic->visible;
+			c->secondary = ic->secondary;
+		}
+
+		projectsvs->project_touch(p);
+	}
+}
+
+static void cmd_import(sourceinfo_t *si, int parc, char *parv[])
+{
+	char *filename = parv[0];
+
+	if (!filename)
+	{
+		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "IMPORT");
+		command_fail(si, fault_needmoreparams, _("Syntax: IMPORT <file>"));
+		return;
+	}
+
+	if (!projectsvs->is_valid_data_file_name(filename, IMPORT_SUFFIX))
+	{
+		command_fail(si, fault_badparams, _("\2%s\2 is not a valid file name. Only \2*%s\2 files can be imported."),
+		             filename, IMPORT_SUFFIX);
+		return;
+	}
+
+	char path[BUFSIZE];
+	snprintf(path, sizeof path, "%s/%s", DATADIR, filename);
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		command_fail(si, fault_nosuch_target, _("Could not open \2%s\2: %s"), filename, strerror(errno));
+		return;
+	}
+
+	struct import_batch b = {
+		.si       = si,
+		.filename = filename,
+		.names    = mowgli_patricia_create(strcasecanon),
+		.channels = mowgli_patricia_create(irccasecanon),
+		.cloaks   = mowgli_patricia_create(strcasecanon),
+	};
+
+	const bool ok = parse_file(&b, f);
+	fclose(f);
+
+	if (!ok)
+	{
+		if (b.errors > IMPORT_MAX_ERRORS)
+			command_fail(si, fault_badparams, _("... and \2%u\2 more errors."), b.errors - IMPORT_MAX_ERRORS);
+		command_fail(si, fault_badparams, _("Nothing was imported from \2%s\2."), filename);
+		batch_free(&b);
+		return;
+	}
+
+	if (!b.projects.count)
+	{
+		command_fail(si, fault_nochange, _("\2%s\2 does not list any projects."), filename);
+		batch_free(&b);
+		return;
+	}
+
+	apply_batch(&b);
+
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:IMPORT: \2%s\2 (%zu projects, %u channel namespaces, %u cloak namespaces, %u contacts)",
+	           filename, b.projects.count, b.nchannels, b.ncloaks, b.ncontacts);
+	command_success_nodata(si, _("Imported \2%zu\2 projects with \2%u\2 channel namespaces, \2%u\2 cloak namespaces and \2%u\2 contacts from \2%s\2."),
+	                       b.projects.count, b.nchannels, b.ncloaks, b.ncontacts, filename);
+
+	batch_free(&b);
+}
+
+static void mod_init(module_t *const restrict m)
+{
+	if (!use_projectns_main_symbols(m))
+		return;
+	service_named_bind_command("projectserv", &ps_import);
+}
+
+static void mod_deinit(const module_unload_intent_t unused)
+{
+	service_named_unbind_command("projectserv", &ps_import);
+}
+
+DECLARE_MODULE_V1
+(
+	"freenode/projectns/import", MODULE_UNLOAD_CAPABILITY_OK, mod_init, mod_deinit,
+	"", "freenode <http://www.freenode.net>"
+);
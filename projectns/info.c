@@ -12,7 +12,7 @@
 
 static void cmd_info(sourceinfo_t *si, int parc, char *parv[]);
 
-static command_t ps_info = { "INFO", N_("Displays information about a project registration."), PRIV_PROJECT_AUSPEX, 1, cmd_info, { .path = "freenode/project_info" } };
+static command_t ps_info = { "INFO", N_("Displays information about a project registration."), PRIV_PROJECT_AUSPEX, 2, cmd_info, { .path = "freenode/project_info" } };
 
 struct info_item
 {
@@ -45,14 +45,62 @@ static void info_item_done(struct info_item *item, bool note_empty)
 	item->buf[0] = '\0';
 }
 
+static void info_section(sourceinfo_t *si, const char *title, const struct project_render_section *s, bool note_empty)
+{
+	for (unsigned int i = 0; i < s->nchunks; i++)
+		command_success_nodata(si, _("%s: %s"), title, s->chunks[i]);
+
+	if (!s->nchunks && note_empty)
+		command_success_nodata(si, _("%s: %s"), title, "(none)");
+}
+
+static void info_online_user_cb(user_t *u, void *privdata)
+{
+	info_item_add(privdata, u->nick);
+}
+
+static void cmd_info_online(sourceinfo_t *si, struct projectns *p)
+{
+	logcommand(si, CMDLOG_GET, "PROJECT:INFO:ONLINE: \2%s\2", p->name);
+	command_success_nodata(si, _("Online users in cloak namespaces of \2%s\2:"), p->name);
+
+	struct info_item info =
+	{
+		.si    = si,
+		.count = 0,
+		.buf   = { 0 },
+	};
+	unsigned int total = 0;
+
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, p->cloak_ns.head)
+	{
+		const struct project_namespace *ns = projectsvs->cloakns_find(n->data);
+
+		info.title = ns->name;
+		info.count = 0;
+		projectsvs->cloakns_foreach_online(ns, info_online_user_cb, &info);
+		info_item_done(&info, true);
+
+		total += info.count;
+	}
+
+	command_success_nodata(si, ngettext(N_("\2%u\2 user online"), N_("\2%u\2 users online"), total), total);
+}
+
 static void cmd_info(sourceinfo_t *si, int parc, char *parv[])
 {
 	char *name = parv[0];
 
-	if (!name)
+	if (!name || (parv[1] && strcasecmp(parv[1], "ONLINE") != 0))
 	{
-		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "INFO");
-		command_fail(si, fault_needmoreparams, _("Syntax: INFO <project>"));
+		cmd_faultcode_t fault = (name ? fault_badparams : fault_needmoreparams);
+
+		if (fault == fault_badparams)
+			command_fail(si, fault, STR_INVALID_PARAMS, "INFO");
+		else
+			command_fail(si, fault, STR_INSUFFICIENT_PARAMS, "INFO");
+		command_fail(si, fault, _("Syntax: INFO <project> [ONLINE]"));
 		return;
 	}
 
@@ -63,6 +111,12 @@ static void cmd_info(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	if (parv[1])
+	{
+		cmd_info_online(si, p);
+		return;
+	}
+
 	logcommand(si, CMDLOG_GET, "PROJECT:INFO: \2%s\2", p->name);
 	command_success_nodata(si, _("Information on \2%s\2:"), p->name);
 
@@ -81,88 +135,19 @@ static void cmd_info(sourceinfo_t *si, int parc, char *parv[])
 	else if (p->creator)
 		command_success_nodata(si, _("Registered by %s"), p->creator);
 
-	struct info_item info =
-	{
-		.si    = si,
-		.title = "Channel namespaces",
-		.count = 0,
-		.buf   = { 0 },
-	};
+	const struct project_render *r = projectsvs->project_render(p, PROJECT_RENDER_INFO);
 
-	mowgli_node_t *n;
-	MOWGLI_ITER_FOREACH(n, p->channel_ns.head)
-	{
-		info_item_add(&info, n->data);
-	}
-	info_item_done(&info, true);
-
-	info.title = "Cloak namespaces";
-	info.count = 0;
-
-	MOWGLI_ITER_FOREACH(n, p->cloak_ns.head)
-	{
-		info_item_add(&info, n->data);
-	}
-	info_item_done(&info, true);
+	info_section(si, "Channel namespaces", &r->sections[PROJECT_RENDER_INFO_CHANNELS], true);
+	info_section(si, "Cloak namespaces", &r->sections[PROJECT_RENDER_INFO_CLOAKS], true);
 
-	info.title = "Group contacts (public)";
-	info.count = 0;
+	info_section(si, "Group contacts (public)", &r->sections[PROJECT_RENDER_INFO_GROUP_PUBLIC], false);
+	info_section(si, "Group contacts (private)", &r->sections[PROJECT_RENDER_INFO_GROUP_PRIVATE], false);
 
-	MOWGLI_ITER_FOREACH(n, p->contacts.head)
-	{
-		struct project_contact *contact = n->data;
-		if (contact->secondary)
-			continue;
-		if (!contact->visible)
-			continue;
-		info_item_add(&info, entity(contact->mu)->name);
-	}
-	info_item_done(&info, false);
-
-	info.title = "Group contacts (private)";
-	// let count accumulate
-
-	MOWGLI_ITER_FOREACH(n, p->contacts.head)
-	{
-		struct project_contact *contact = n->data;
-		if (contact->secondary)
-			continue;
-		if (contact->visible)
-			continue;
-		info_item_add(&info, entity(contact->mu)->name);
-	}
-	info_item_done(&info, false);
-
-	if (!info.count)
+	if (!r->sections[PROJECT_RENDER_INFO_GROUP_PUBLIC].items && !r->sections[PROJECT_RENDER_INFO_GROUP_PRIVATE].items)
 		command_success_nodata(si, _("Group contacts: (none)"));
 
-	info.title = "Secondary contacts (public)";
-	info.count = 0;
-
-	MOWGLI_ITER_FOREACH(n, p->contacts.head)
-	{
-		struct project_contact *contact = n->data;
-		if (!contact->secondary)
-			continue;
-		if (!contact->visible)
-			continue;
-		info_item_add(&info, entity(contact->mu)->name);
-	}
-	info_item_done(&info, false);
-
-	info.title = "Secondary contacts (private)";
-	info.count = 0;
-
-	MOWGLI_ITER_FOREACH(n, p->contacts.head)
-	{
-		struct project_contact *contact = n->data;
-		if (!contact->secondary)
-			continue;
-		if (contact->visible)
-			continue;
-		info_item_add(&info, entity(contact->mu)->name);
-	}
-	info_item_done(&info, false);
+	info_section(si, "Secondary contacts (public)", &r->sections[PROJECT_RENDER_INFO_SECONDARY_PUBLIC], false);
+	info_section(si, "Secondary contacts (private)", &r->sections[PROJECT_RENDER_INFO_SECONDARY_PRIVATE], false);
 
 	if (p->reginfo)
 		command_success_nodata(si, _("\"See also\" displayed when registering channels: %s"), p->reginfo);
@@ -172,7 +157,7 @@ static void cmd_info(sourceinfo_t *si, int parc, char *parv[])
 	else
 		command_success_nodata(si, _("Only group contacts may register channels in the project namespace"));
 
-	projectsvs->show_marks(si, p);
+	projectsvs->show_marks(si, p, 0, 0);
 
 	command_success_nodata(si, _("*** \2End of Info\2 ***"));
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Command to show and dump hook latency histograms
+ */
+
+#include "fn-compat.h"
+#include "atheme.h"
+#include "projectns.h"
+
+#define LATENCY_DUMP_SUFFIX ".latency"
+
+static void cmd_latency(sourceinfo_t *si, int parc, char *parv[]);
+
+static command_t ps_latency = {
+	.name       = "LATENCY",
+	.desc       = N_("Shows how long projectns hooks take"),
+	.access     = PRIV_PROJECT_AUSPEX,
+	.maxparc    = 2,
+	.cmd        = cmd_latency,
+	.help       = { .path = "freenode/project_latency" },
+};
+
+static const char * const hook_names[PROJECTNS_HOOKS] = {
+	[PROJECTNS_HOOK_TRY_REGISTER] = "channel_can_register",
+	[PROJECTNS_HOOK_DID_REGISTER] = "channel_register",
+	[PROJECTNS_HOOK_CHANINFO]     = "channel_info",
+	[PROJECTNS_HOOK_USERINFO]     = "user_info",
+};
+
+// Upper bound of the bucket holding the q-th quantile (in per mille), in microseconds
+static double latency_quantile(const struct latency_histogram * const h, const unsigned int q)
+{
+	const uint64_t rank = (h->calls * q + 999) / 1000;
+	uint64_t seen = 0;
+
+	for (unsigned int i = 0; i < LATENCY_BUCKETS - 1; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= rank)
+			return (double)(UINT64_C(2) << i) / 1e3;
+	}
+
+	return h->max_ns / 1e3;
+}
+
+static void show_latency(sourceinfo_t *si)
+{
+	command_success_nodata(si, _("%-22s %10s %10s %10s %10s %10s %10s"), _("Hook"), _("Calls"), _("Mean"), _("p50"), _("p90"), _("p99"), _("Max"));
+
+	for (unsigned int i = 0; i < PROJECTNS_HOOKS; i++)
+	{
+		const struct latency_histogram *h = &projectsvs->hook_latency[i];
+
+		if (!h->calls)
+		{
+			command_success_nodata(si, "%-22s %10u", hook_names[i], 0U);
+			continue;
+		}
+
+		command_success_nodata(si, "%-22s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f", hook_names[i],
+		                       (unsigned long long)h->calls, h->total_ns / 1e3 / h->calls,
+		                       latency_quantile(h, 500), latency_quantile(h, 900), latency_quantile(h, 990),
+		                       h->max_ns / 1e3);
+	}
+
+	command_success_nodata(si, _("Times are in microseconds; percentiles are rounded up to a power of two nanoseconds."));
+}
+
+// One line per non-empty bucket: hook, lower bound (ns), upper bound (ns), calls
+static bool dump_latency(const char * const path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+
+	fprintf(f, "# projectns hook latency at %lu\n", (unsigned long)CURRTIME);
+
+	for (unsigned int i = 0; i < PROJECTNS_HOOKS; i++)
+	{
+		const struct latency_histogram *h = &projectsvs->hook_latency[i];
+
+		fprintf(f, "# %s calls %llu total_ns %llu max_ns %llu\n", hook_names[i],
+		        (unsigned long long)h->calls, (unsigned long long)h->total_ns, (unsigned long long)h->max_ns);
+
+		for (unsigned int b = 0; b < LATENCY_BUCKETS; b++)
+		{
+			if (!h->buckets[b])
+				continue;
+
+			fprintf(f, "%s %llu %llu %llu\n", hook_names[i],
+			        b ? 1ULL << b : 0ULL, 1ULL << (b + 1), (unsigned long long)h->buckets[b]);
+		}
+	}
+
+	const bool ok = !ferror(f);
+	return fclose(f) == 0 && ok;
+}
+
+static void cmd_latency(sourceinfo_t *si, int parc, char *parv[])
+{
+	char *mode = parv[0];
+	char *filename = parv[1];
+
+	if (!mode)
+	{
+		show_latency(si);
+		logcommand(si, CMDLOG_ADMIN, "PROJECT:LATENCY");
+		return;
+	}
+
+	if (strcasecmp(mode, "RESET") == 0 && !filename)
+	{
+		if (!has_priv(si, PRIV_PROJECT_ADMIN))
+		{
+			command_fail(si, fault_noprivs, _("You are not authorized to perform this operation."));
+			return;
+		}
+
+		memset(projectsvs->hook_latency, 0, sizeof projectsvs->hook_latency);
+
+		logcommand(si, CMDLOG_ADMIN, "PROJECT:LATENCY:RESET");
+		command_success_nodata(si, _("Hook latency statistics have been reset."));
+		return;
+	}
+
+	if (strcasecmp(mode, "DUMP") == 0 && filename)
+	{
+		if (!has_priv(si, PRIV_PROJECT_ADMIN))
+		{
+			command_fail(si, fault_noprivs, _("You are not authorized to perform this operation."));
+			return;
+		}
+
+		if (!projectsvs->is_valid_data_file_name(filename, LATENCY_DUMP_SUFFIX))
+		{
+			command_fail(si, fault_badparams, _("\2%s\2 is not a valid file name. Histograms can only be written to \2*%s\2 files."),
+			             filename, LATENCY_DUMP_SUFFIX);
+			return;
+		}
+
+		char path[BUFSIZE];
+		snprintf(path, sizeof path, "%s/%s", DATADIR, filename);
+
+		if (!dump_latency(path))
+		{
+			command_fail(si, fault_internalerror, _("Could not write \2%s\2: %s"), filename, strerror(errno));
+			return;
+		}
+
+		logcommand(si, CMDLOG_ADMIN, "PROJECT:LATENCY:DUMP: \2%s\2", filename);
+		command_success_nodata(si, _("Hook latency histograms have been written to \2%s\2."), filename);
+		return;
+	}
+
+	command_fail(si, fault_badparams, STR_INVALID_PARAMS, "LATENCY");
+	command_fail(si, fault_badparams, _("Syntax: LATENCY [RESET|DUMP <file>]"));
+}
+
+static void mod_init(module_t *const restrict m)
+{
+	if (!use_projectns_main_symbols(m))
+		return;
+	service_named_bind_command("projectserv", &ps_latency);
+}
+
+static void mod_deinit(const module_unload_intent_t unused)
+{
+	service_named_unbind_command("projectserv", &ps_latency);
+}
+
+DECLARE_MODULE_V1
+(
+	"freenode/projectns/latency", MODULE_UNLOAD_CAPABILITY_OK, mod_init, mod_deinit,
+	"", "freenode <http://www.freenode.net>"
+);
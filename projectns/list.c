@@ -12,58 +12,269 @@
 
 static void cmd_list(sourceinfo_t *si, int parc, char *parv[]);
 
-static command_t ps_list = { "LIST", N_("Lists project registrations."), PRIV_PROJECT_AUSPEX, 1, cmd_list, { .path = "freenode/project_list" } };
+static command_t ps_list = { "LIST", N_("Lists project registrations."), PRIV_PROJECT_AUSPEX, 13, cmd_list, { .path = "freenode/project_list" } };
+
+#define LIST_SYNTAX "Syntax: LIST <pattern> [CREATED AFTER|BEFORE <time>] [BY <oper>] [LIMIT <n>] [NEXT <project>|<time>:<project>]"
+
+struct list_state
+{
+	sourceinfo_t *si;
+	unsigned int matches;
+	struct compiled_glob *glob;
+	unsigned int limit;
+	const char *last;  // key of the last entry listed
+	bool more;         // stopped at the limit with more entries left
+
+	// CREATED and BY filters
+	time_t created_after;
+	time_t created_before;  // 0 for no upper bound
+	const char *creator;
+	time_t last_time;       // creation time of the last entry listed
+};
+
+static void show_project(sourceinfo_t *si, struct projectns *project)
+{
+	char channels[BUFSIZE] = "";
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
+	{
+		if (channels[0])
+			mowgli_strlcat(channels, ", ", sizeof channels);
+		mowgli_strlcat(channels, (const char*)n->data, sizeof channels);
+	}
+
+	char contacts[BUFSIZE] = "";
+	MOWGLI_ITER_FOREACH(n, project->contacts.head)
+	{
+		struct project_contact *contact = n->data;
+		if (contacts[0])
+			mowgli_strlcat(contacts, ", ", sizeof contacts);
+		mowgli_strlcat(contacts, ((myentity_t*)contact->mu)->name, sizeof contacts);
+	}
+	command_success_nodata(si, _("- %s (%s; %s)"), project->name,
+	                           (channels[0] ? channels : _("\2no channels\2")),
+	                           (contacts[0] ? contacts : _("\2no contacts\2")));
+}
+
+// Called once for each project name starting with the pattern's literal prefix
+static int cmd_list_cb(const char *name, void *data, void *privdata)
+{
+	struct projectns * const project = data;
+	struct list_state * const st = privdata;
+
+	if (!projectsvs->glob_match(st->glob, name))
+		return 0;
+
+	if (st->limit && st->matches == st->limit)
+	{
+		st->more = true;
+		return 1;
+	}
+
+	st->matches++;
+	st->last = name;
+	show_project(st->si, project);
+
+	return 0;
+}
+
+// Called in order of creation for each project passing the CREATED and BY filters
+static int cmd_list_filter_cb(struct projectns *project, void *privdata)
+{
+	struct list_state * const st = privdata;
+
+	if (!projectsvs->glob_match(st->glob, project->name))
+		return 0;
+
+	if (st->limit && st->matches == st->limit)
+	{
+		st->more = true;
+		return 1;
+	}
+
+	st->matches++;
+	st->last = project->name;
+	st->last_time = project->creation_time;
+	show_project(st->si, project);
+
+	return 0;
+}
+
+// Filtered listings resume after a "<time>:<project>" cursor
+static bool parse_list_cursor(const char *arg, time_t *time, const char **name)
+{
+	char *end;
+
+	errno = 0;
+	unsigned long long value = strtoull(arg, &end, 10);
+
+	if (errno || end == arg || *end != ':' || !end[1])
+		return false;
+
+	*time = (time_t)value;
+	*name = end + 1;
+	return true;
+}
+
+// Either a UNIX timestamp or a duration like 30d meaning that long ago
+static bool parse_list_time(const char *arg, time_t *out)
+{
+	char *end;
+
+	errno = 0;
+	unsigned long long value = strtoull(arg, &end, 10);
+
+	if (errno || end == arg)
+		return false;
+
+	if (!*end)
+	{
+		*out = (time_t)value;
+		return true;
+	}
+
+	unsigned long long unit;
+	switch (*end)
+	{
+		case 's': unit = 1; break;
+		case 'm': unit = 60; break;
+		case 'h': unit = 3600; break;
+		case 'd': unit = 86400; break;
+		case 'w': unit = 604800; break;
+		default:  return false;
+	}
+
+	if (end[1] || value > (unsigned long long)CURRTIME / unit)
+		return false;
+
+	*out = CURRTIME - (time_t)(value * unit);
+	return true;
+}
 
 static void cmd_list(sourceinfo_t *si, int parc, char *parv[])
 {
 	char *pattern = parv[0];
+	struct page_options opts;
+	struct list_state st = { .si = si };
 
 	if (!pattern)
 	{
 		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "LIST");
-		command_fail(si, fault_needmoreparams, _("Syntax: LIST <pattern>"));
+		command_fail(si, fault_needmoreparams, _(LIST_SYNTAX));
 		return;
 	}
 
-	mowgli_patricia_iteration_state_t state;
-	struct projectns *project;
-	unsigned int matches = 0;
+	// pick out the filters and leave LIMIT and NEXT to parse_page_options()
+	char *page_parv[4];
+	int page_parc = 0;
+	bool ok = true;
+
+	for (int i = 1; i < parc && ok; )
+	{
+		if (strcasecmp(parv[i], "CREATED") == 0 && i + 2 < parc)
+		{
+			if (strcasecmp(parv[i + 1], "AFTER") == 0)
+				ok = parse_list_time(parv[i + 2], &st.created_after);
+			else if (strcasecmp(parv[i + 1], "BEFORE") == 0)
+				ok = parse_list_time(parv[i + 2], &st.created_before) && st.created_before;
+			else
+				ok = false;
+			i += 3;
+		}
+		else if (strcasecmp(parv[i], "BY") == 0 && i + 1 < parc)
+		{
+			st.creator = parv[i + 1];
+			i += 2;
+		}
+		else if (i + 1 < parc && page_parc < 4)
+		{
+			page_parv[page_parc++] = parv[i];
+			page_parv[page_parc++] = parv[i + 1];
+			i += 2;
+		}
+		else
+		{
+			ok = false;
+		}
+	}
+
+	if (!ok || !projectsvs->parse_page_options(page_parc, page_parv, &opts))
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "LIST");
+		command_fail(si, fault_badparams, _(LIST_SYNTAX));
+		return;
+	}
+
+	bool filtered = st.creator || st.created_after || st.created_before;
+	time_t from_time = 0;
+	const char *from_name = NULL;
+
+	if (filtered && opts.after && !parse_list_cursor(opts.after, &from_time, &from_name))
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "LIST");
+		command_fail(si, fault_badparams, _(LIST_SYNTAX));
+		return;
+	}
+
+	st.glob  = projectsvs->glob_compile(pattern);
+	st.limit = opts.limit;
 
 	command_success_nodata(si, _("Registered projects matching pattern \2%s\2:"), pattern);
 
-	MOWGLI_PATRICIA_FOREACH(project, &state, projectsvs->projects)
+	// the continuation hint repeats the filters, with times made absolute
+	char filters[BUFSIZE] = "";
+	char next[BUFSIZE] = "";
+
+	if (filtered)
 	{
-		if (!match(pattern, project->name))
+		/* Walk the creator's own projects, or everything created in the time
+		 * range, in order of creation from the cursor on, stopping at the limit.
+		 */
+		projectsvs->projects_by_creation(st.created_after, st.created_before, st.creator,
+		                                 from_time, from_name, cmd_list_filter_cb, &st);
+
+		if (st.more)
+			snprintf(next, sizeof next, "%lu:%s", (unsigned long)st.last_time, st.last);
+
+		char buf[BUFSIZE];
+		if (st.created_after)
+		{
+			snprintf(buf, sizeof buf, " CREATED AFTER %lu", (unsigned long)st.created_after);
+			mowgli_strlcat(filters, buf, sizeof filters);
+		}
+		if (st.created_before)
+		{
+			snprintf(buf, sizeof buf, " CREATED BEFORE %lu", (unsigned long)st.created_before);
+			mowgli_strlcat(filters, buf, sizeof filters);
+		}
+		if (st.creator)
 		{
-			matches++;
-			char channels[BUFSIZE] = "";
-			mowgli_node_t *n;
-			MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
-			{
-				if (channels[0])
-					mowgli_strlcat(channels, ", ", sizeof channels);
-				mowgli_strlcat(channels, (const char*)n->data, sizeof channels);
-			}
-
-			char contacts[BUFSIZE] = "";
-			MOWGLI_ITER_FOREACH(n, project->contacts.head)
-			{
-				struct project_contact *contact = n->data;
-				if (contacts[0])
-					mowgli_strlcat(contacts, ", ", sizeof contacts);
-				mowgli_strlcat(contacts, ((myentity_t*)contact->mu)->name, sizeof contacts);
-			}
-			command_success_nodata(si, _("- %s (%s; %s)"), project->name,
-			                           (channels[0] ? channels : _("\2no channels\2")),
-			                           (contacts[0] ? contacts : _("\2no contacts\2")));
+			snprintf(buf, sizeof buf, " BY %s", st.creator);
+			mowgli_strlcat(filters, buf, sizeof filters);
 		}
 	}
+	else
+	{
+		// only names starting with the pattern's literal part can match
+		char prefix[PROJECTNAMELEN + 1];
+		projectsvs->glob_literal_prefix(pattern, prefix, sizeof prefix);
+		projectsvs->projects_foreach_prefix(prefix, opts.after, cmd_list_cb, &st);
 
-	if (matches == 0)
+		if (st.more)
+			mowgli_strlcpy(next, st.last, sizeof next);
+	}
+
+	if (st.matches == 0)
 		command_success_nodata(si, _("No projects matched pattern \2%s\2"), pattern);
+	else if (st.more)
+		command_success_nodata(si, ngettext(N_("\2%d\2 match shown for pattern \2%s\2"), N_("\2%d\2 matches shown for pattern \2%s\2"), st.matches), st.matches, pattern);
 	else
-		command_success_nodata(si, ngettext(N_("\2%d\2 match for pattern \2%s\2"), N_("\2%d\2 matches for pattern \2%s\2"), matches), matches, pattern);
-	logcommand(si, CMDLOG_ADMIN, "PROJECT:LIST: \2%s\2 (\2%d\2 matches)", pattern, matches);
+		command_success_nodata(si, ngettext(N_("\2%d\2 match for pattern \2%s\2"), N_("\2%d\2 matches for pattern \2%s\2"), st.matches), st.matches, pattern);
+	if (st.more)
+		command_success_nodata(si, _("More projects match; continue with \2LIST %s%s LIMIT %u NEXT %s\2"), pattern, filters, st.limit, next);
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:LIST: \2%s\2%s (\2%d\2 matches%s)", pattern, filters, st.matches, st.more ? " shown" : "");
+
+	projectsvs->glob_free(st.glob);
 }
 
 static void mod_init(module_t *const restrict m)
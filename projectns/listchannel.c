@@ -13,49 +13,56 @@
 
 static void cmd_listchannel(sourceinfo_t *si, int parc, char *parv[]);
 
-static command_t ps_listchannel = { "LISTCHANNEL", N_("Lists channel namespaces."), PRIV_PROJECT_AUSPEX, 1, cmd_listchannel, { .path = "freenode/project_listchannel" } };
+static command_t ps_listchannel = { "LISTCHANNEL", N_("Lists channel namespaces."), PRIV_PROJECT_AUSPEX, 5, cmd_listchannel, { .path = "freenode/project_listchannel" } };
 
 struct each_channel_state
 {
 	sourceinfo_t *si;
 	unsigned int matches;
-	const char *pattern;
+	struct compiled_glob *glob;
+	unsigned int limit;
+	const char *last;  // key of the last entry listed
+	bool more;         // stopped at the limit with more entries left
 };
 
-// Called once for each entry in the channel->project mapping
+// Called once for each channel namespace starting with the pattern's literal prefix
 static int cmd_listchannel_cb(const char *channelns, void *data, void *privdata)
 {
-	struct projectns * const project = data;
+	const struct project_namespace * const ns = data;
 	struct each_channel_state * const st = privdata;
 
-	if (!match(st->pattern, channelns))
+	if (projectsvs->glob_match(st->glob, channelns))
 	{
-		// We have to find the actual entry as patricia tree keys are
-		// stored in case-normalized form
-		mowgli_node_t *n;
-		MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
+		if (st->limit && st->matches == st->limit)
 		{
-			const char * const actual_channelns = n->data;
-			if (0 == irccasecmp(actual_channelns, channelns))
-			{
-				st->matches++;
-				command_success_nodata(st->si, _("- %s (%s)"), actual_channelns, project->name);
-				break;
-			}
+			st->more = true;
+			return 1;
 		}
+
+		st->matches++;
+		st->last = channelns;
+		command_success_nodata(st->si, _("- %s (%s)"), ns->name, ns->project->name);
 	}
 
-	return 0; // unused by foreach
+	return 0;
 }
 
 static void cmd_listchannel(sourceinfo_t *si, int parc, char *parv[])
 {
 	const char *pattern = parv[0];
+	struct page_options opts;
 
 	if (!pattern)
 	{
 		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "LISTCHANNEL");
-		command_fail(si, fault_needmoreparams, _("Syntax: LISTCHANNEL <pattern>"));
+		command_fail(si, fault_needmoreparams, _("Syntax: LISTCHANNEL <pattern> [LIMIT <n>] [NEXT <namespace>]"));
+		return;
+	}
+
+	if (!projectsvs->parse_page_options(parc - 1, parv + 1, &opts))
+	{
+		command_fail(si, fault_badparams, STR_INVALID_PARAMS, "LISTCHANNEL");
+		command_fail(si, fault_badparams, _("Syntax: LISTCHANNEL <pattern> [LIMIT <n>] [NEXT <namespace>]"));
 		return;
 	}
 
@@ -65,16 +72,25 @@ static void cmd_listchannel(sourceinfo_t *si, int parc, char *parv[])
 		{
 			.si = si,
 			.matches = 0,
-			.pattern = pattern,
+			.glob = projectsvs->glob_compile(pattern),
+			.limit = opts.limit,
 		};
 
-	mowgli_patricia_foreach(projectsvs->projects_by_channelns, cmd_listchannel_cb, &st);
+	// only namespaces starting with the pattern's literal part can match
+	char prefix[CHANNELLEN + 1];
+	projectsvs->glob_literal_prefix(pattern, prefix, sizeof prefix);
+	projectsvs->channelns_foreach_prefix(prefix, opts.after, cmd_listchannel_cb, &st);
+	projectsvs->glob_free(st.glob);
 
 	if (st.matches == 0)
 		command_success_nodata(si, _("No channel namespaces matched pattern \2%s\2"), pattern);
+	else if (st.more)
+		command_success_nodata(si, ngettext(N_("\2%d\2 match shown for pattern \2%s\2"), N_("\2%d\2 matches shown for pattern \2%s\2"), st.matches), st.matches, pattern);
 	else
 		command_success_nodata(si, ngettext(N_("\2%d\2 match for pattern \2%s\2"), N_("\2%d\2 matches for pattern \2%s\2"), st.matches), st.matches, pattern);
-	logcommand(si, CMDLOG_ADMIN, "PROJECT:LISTCHANNEL: \2%s\2 (\2%d\2 matches)", pattern, st.matches);
+	if (st.more)
+		command_success_nodata(si, _("More channel namespaces match; continue with \2LISTCHANNEL %s LIMIT %u NEXT %s\2"), pattern, st.limit, st.last);
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:LISTCHANNEL: \2%s\2 (\2%d\2 matches%s)", pattern, st.matches, st.more ? " shown" : "");
 }
 
 static void mod_init(module_t *const restrict m)
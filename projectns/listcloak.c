@@ -13,49 +13,87 @@
 
 static void cmd_listcloak(sourceinfo_t *si, int parc, char *parv[]);
 
-static command_t ps_listcloak = { "LISTCLOAK", N_("Lists cloak namespaces."), PRIV_PROJECT_AUSPEX, 1, cmd_listcloak, { .path = "freenode/project_listcloak" } };
+static command_t ps_listcloak = { "LISTCLOAK", N_("Lists cloak namespaces."), PRIV_PROJECT_AUSPEX, 5, cmd_listcloak, { .path = "freenode/project_listcloak" } };
 
 struct each_cloak_state
 {
 	sourceinfo_t *si;
 	unsigned int matches;
-	const char *pattern;
+	struct compiled_glob *glob;
+	unsigned int limit;
+	const char *last;  // key of the last entry listed
+	bool more;         // stopped at the limit with more entries left
 };
 
-// Called once for each entry in the cloak->project mapping
+// Called once for each cloak namespace starting with the pattern's literal prefix
 static int cmd_listcloak_cb(const char *cloakns, void *data, void *privdata)
 {
-	struct projectns * const project = data;
+	const struct project_namespace * const ns = data;
 	struct each_cloak_state * const st = privdata;
 
-	if (!match(st->pattern, cloakns))
+	if (projectsvs->glob_match(st->glob, cloakns))
 	{
-		// We have to find the actual entry as patricia tree keys are
-		// stored in case-normalized form
-		mowgli_node_t *n;
-		MOWGLI_ITER_FOREACH(n, project->cloak_ns.head)
+		if (st->limit && st->matches == st->limit)
 		{
-			const char * const actual_cloakns = n->data;
-			if (0 == strcasecmp(actual_cloakns, cloakns))
-			{
-				st->matches++;
-				command_success_nodata(st->si, _("- %s (%s)"), actual_cloakns, project->name);
-				break;
-			}
+			st->more = true;
+			return 1;
 		}
+
+		st->matches++;
+		st->last = cloakns;
+		command_success_nodata(st->si, _("- %s (%s)"), ns->name, ns->project->name);
 	}
 
-	return 0; // unused by foreach
+	return 0;
+}
+
+static void list_online_user_cb(user_t *u, void *privdata)
+{
+	sourceinfo_t *si = privdata;
+
+	command_success_nodata(si, _("- %s!%s@%s"), u->nick, u->user, u->vhost);
+}
+
+static void cmd_listcloak_users(sourceinfo_t *si, const char *namespace)
+{
+	const struct project_namespace *ns = projectsvs->cloakns_find(namespace);
+
+	if (!ns)
+	{
+		command_fail(si, fault_nosuch_target, _("The \2%s\2 namespace is not registered to any project."), namespace);
+		return;
+	}
+
+	command_success_nodata(si, _("Online users in cloak namespace \2%s\2 (%s):"), ns->name, ns->project->name);
+
+	unsigned int matches = projectsvs->cloakns_foreach_online(ns, list_online_user_cb, si);
+
+	command_success_nodata(si, ngettext(N_("\2%u\2 user online"), N_("\2%u\2 users online"), matches), matches);
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:LISTCLOAK:USERS: \2%s\2 (\2%u\2 users)", ns->name, matches);
 }
 
 static void cmd_listcloak(sourceinfo_t *si, int parc, char *parv[])
 {
 	const char *pattern = parv[0];
+	const bool users = parc == 2 && strcasecmp(parv[1], "USERS") == 0;
+	struct page_options opts;
+
+	if (!pattern || (!users && !projectsvs->parse_page_options(parc - 1, parv + 1, &opts)))
+	{
+		cmd_faultcode_t fault = (pattern ? fault_badparams : fault_needmoreparams);
+
+		if (fault == fault_badparams)
+			command_fail(si, fault, STR_INVALID_PARAMS, "LISTCLOAK");
+		else
+			command_fail(si, fault, STR_INSUFFICIENT_PARAMS, "LISTCLOAK");
+		command_fail(si, fault, _("Syntax: LISTCLOAK <pattern> [LIMIT <n>] [NEXT <namespace>]"));
+		command_fail(si, fault, _("Syntax: LISTCLOAK <namespace> USERS"));
+		return;
+	}
 
-	if (!pattern)
+	if (users)
 	{
-		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "LISTCLOAK");
-		command_fail(si, fault_needmoreparams, _("Syntax: LISTCLOAK <pattern>"));
+		cmd_listcloak_users(si, pattern);
 		return;
 	}
 
@@ -65,16 +103,25 @@ static void cmd_listcloak(sourceinfo_t *si, int parc, char *parv[])
 		{
 			.si = si,
 			.matches = 0,
-			.pattern = pattern,
+			.glob = projectsvs->glob_compile(pattern),
+			.limit = opts.limit,
 		};
 
-	mowgli_patricia_foreach(projectsvs->projects_by_cloakns, cmd_listcloak_cb, &st);
+	// only namespaces starting with the pattern's literal part can match
+	char prefix[HOSTLEN + 1];
+	projectsvs->glob_literal_prefix(pattern, prefix, sizeof prefix);
+	projectsvs->cloakns_foreach_prefix(prefix, opts.after, cmd_listcloak_cb, &st);
+	projectsvs->glob_free(st.glob);
 
 	if (st.matches == 0)
 		command_success_nodata(si, _("No cloak namespaces matched pattern \2%s\2"), pattern);
+	else if (st.more)
+		command_success_nodata(si, ngettext(N_("\2%d\2 match shown for pattern \2%s\2"), N_("\2%d\2 matches shown for pattern \2%s\2"), st.matches), st.matches, pattern);
 	else
 		command_success_nodata(si, ngettext(N_("\2%d\2 match for pattern \2%s\2"), N_("\2%d\2 matches for pattern \2%s\2"), st.matches), st.matches, pattern);
-	logcommand(si, CMDLOG_ADMIN, "PROJECT:LISTCLOAK: \2%s\2 (\2%d\2 matches)", pattern, st.matches);
+	if (st.more)
+		command_success_nodata(si, _("More cloak namespaces match; continue with \2LISTCLOAK %s LIMIT %u NEXT %s\2"), pattern, st.limit, st.last);
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:LISTCLOAK: \2%s\2 (\2%d\2 matches%s)", pattern, st.matches, st.more ? " shown" : "");
 }
 
 static void mod_init(module_t *const restrict m)
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Object pools
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Projects, contacts and marks live on mowgli heaps; namespace entries (list
+ * node plus name) are packed into a simple block arena. A block is released
+ * once everything allocated from it has been freed, or reused in place if it
+ * is the block currently being filled.
+ */
+
+#define ARENA_BLOCK_SIZE 16384
+#define ARENA_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+struct arena_block {
+	mowgli_node_t node;
+	size_t size;
+	size_t used;
+	unsigned int live;
+	void *data[];
+};
+
+struct object_pools object_pools;
+
+static const struct {
+	const char *name;
+	size_t offset;
+	size_t elem_size;
+	unsigned int block_elems;
+} slab_info[] = {
+	{ "projects", offsetof(struct object_pools, projects), sizeof(struct projectns),       256 },
+	{ "contacts", offsetof(struct object_pools, contacts), sizeof(struct project_contact), 512 },
+	{ "marks",    offsetof(struct object_pools, marks),    sizeof(struct project_mark),    256 },
+};
+
+#define SLAB_COUNT (sizeof slab_info / sizeof slab_info[0])
+
+void *slab_alloc(struct slab * const s)
+{
+	void *ptr = mowgli_heap_alloc(s->heap);
+	memset(ptr, 0, s->elem_size);
+
+	if (++s->live > s->peak)
+		s->peak = s->live;
+
+	return ptr;
+}
+
+void slab_free(struct slab * const s, void * const ptr)
+{
+	mowgli_heap_free(s->heap, ptr);
+	s->live--;
+}
+
+void *arena_alloc(struct string_arena * const a, const size_t size)
+{
+	const size_t need = ARENA_ALIGN(sizeof(struct arena_block *) + size);
+	struct arena_block *b = a->current;
+
+	if (!b || b->size - b->used < need)
+	{
+		// oversized requests get a block of their own and leave the current one alone
+		const size_t block_size = need > ARENA_BLOCK_SIZE ? need : ARENA_BLOCK_SIZE;
+
+		b = smalloc(sizeof *b + block_size);
+		b->size = block_size;
+		b->used = 0;
+		b->live = 0;
+		mowgli_node_add(b, &b->node, &a->blocks);
+		a->reserved += block_size;
+
+		if (block_size == ARENA_BLOCK_SIZE)
+			a->current = b;
+	}
+
+	struct arena_block **hdr = (struct arena_block **)((char *)b->data + b->used);
+	*hdr = b;
+
+	b->used += need;
+	b->live++;
+	a->live++;
+	a->live_bytes += need;
+
+	return hdr + 1;
+}
+
+void arena_free(struct string_arena * const a, void * const ptr, const size_t size)
+{
+	struct arena_block *b = ((struct arena_block **)ptr)[-1];
+
+	b->live--;
+	a->live--;
+	a->live_bytes -= ARENA_ALIGN(sizeof(struct arena_block *) + size);
+
+	if (b->live)
+		return;
+
+	if (b == a->current)
+	{
+		b->used = 0;
+		return;
+	}
+
+	mowgli_node_delete(&b->node, &a->blocks);
+	a->reserved -= b->size;
+	free(b);
+}
+
+void init_object_pools(void)
+{
+	for (size_t i = 0; i < SLAB_COUNT; i++)
+	{
+		struct slab *s = (struct slab *)((char *)&object_pools + slab_info[i].offset);
+
+		s->heap      = mowgli_heap_create(slab_info[i].elem_size, slab_info[i].block_elems, BH_NOW);
+		s->elem_size = slab_info[i].elem_size;
+		s->live      = 0;
+		s->peak      = 0;
+	}
+
+	memset(&object_pools.namespaces, 0, sizeof object_pools.namespaces);
+}
+
+// Frees every pool wholesale, including any objects still allocated from it
+void destroy_object_pools(struct object_pools * const pools)
+{
+	for (size_t i = 0; i < SLAB_COUNT; i++)
+	{
+		struct slab *s = (struct slab *)((char *)pools + slab_info[i].offset);
+
+		if (s->heap)
+			mowgli_heap_destroy(s->heap);
+		s->heap = NULL;
+	}
+
+	mowgli_node_t *n, *tn;
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, pools->namespaces.blocks.head)
+	{
+		mowgli_node_delete(n, &pools->namespaces.blocks);
+		free(n->data);
+	}
+
+	memset(&pools->namespaces, 0, sizeof pools->namespaces);
+}
+
+void show_pool_stats(sourceinfo_t *si)
+{
+	for (size_t i = 0; i < SLAB_COUNT; i++)
+	{
+		const struct slab *s = (const struct slab *)((const char *)&object_pools + slab_info[i].offset);
+		const unsigned int blocks = (s->live + slab_info[i].block_elems - 1) / slab_info[i].block_elems;
+
+		command_success_nodata(si, _("%-10s %u in use (peak %u), %zu bytes each, %u per block, at least %u blocks (%u%% occupied)"),
+		                       slab_info[i].name, s->live, s->peak, s->elem_size, slab_info[i].block_elems, blocks,
+		                       blocks ? (unsigned int)(s->live * 100ULL / (blocks * slab_info[i].block_elems)) : 0U);
+	}
+
+	const struct string_arena *a = &object_pools.namespaces;
+
+	command_success_nodata(si, _("%-10s %u in use, %zu of %zu bytes in %zu blocks (%u%% occupied)"),
+	                       "namespaces", a->live, a->live_bytes, a->reserved, a->blocks.count,
+	                       a->reserved ? (unsigned int)(a->live_bytes * 100ULL / a->reserved) : 0U);
+}
@@ -8,15 +8,38 @@
 
 #include "main.h"
 
+// Lookup table form of NAMESPACE_SEPARATORS, rebuilt whenever the configuration is (re)loaded
+bool namespace_separator_map[UCHAR_MAX + 1];
+
+static void build_separator_map(void *unused)
+{
+	memset(namespace_separator_map, 0, sizeof namespace_separator_map);
+
+	if (!projectsvs.config.namespace_separators)
+		return;
+
+	for (const char *c = projectsvs.config.namespace_separators; *c; c++)
+		namespace_separator_map[(unsigned char)*c] = true;
+}
+
 void init_config(void)
 {
 	add_dupstr_conf_item("NAMESPACE_SEPARATORS", &projectsvs.me->conf_table, 0, &projectsvs.config.namespace_separators, "-");
 	add_bool_conf_item("DEFAULT_OPEN_REGISTRATION", &projectsvs.me->conf_table, 0, &projectsvs.config.default_open_registration, false);
+	add_bool_conf_item("JOURNAL", &projectsvs.me->conf_table, 0, &projectsvs.config.journal, false);
+	add_uint_conf_item("JOURNAL_COMPACT", &projectsvs.me->conf_table, 0, &projectsvs.config.journal_compact, 1, UINT_MAX, 10000);
+
+	build_separator_map(NULL);
+	hook_add_config_ready(build_separator_map);
 }
 
 void deinit_config(void)
 {
+	hook_del_config_ready(build_separator_map);
+
 	del_conf_item("NAMESPACE_SEPARATORS", &projectsvs.me->conf_table);
 	del_conf_item("DEFAULT_OPEN_REGISTRATION", &projectsvs.me->conf_table);
+	del_conf_item("JOURNAL", &projectsvs.me->conf_table);
+	del_conf_item("JOURNAL_COMPACT", &projectsvs.me->conf_table);
 	free(projectsvs.config.namespace_separators);
 }
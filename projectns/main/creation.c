@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Indexes on registration time and creator
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Projects ordered by creation time (a sorted array), and those of each creator
+ * in the same order (sorted arrays hanging off a patricia tree), for LIST's
+ * CREATED and BY filters. Ties are broken by name, so a listing can resume
+ * after any (time, name) pair with a binary search.
+ *
+ * Both are only built when first queried and kept up to date from then on.
+ * Loading the database or replaying the journal creates projects in no
+ * particular time order, which would make keeping the arrays sorted throughout
+ * quadratic; after that, new registrations simply append to them. Nothing needs
+ * to be carried over a reload either, as the next query rebuilds them.
+ */
+
+struct creation_entry {
+	time_t time;
+	struct projectns *project;
+};
+
+struct creation_array {
+	struct creation_entry *entries;
+	size_t count;
+	size_t size;
+};
+
+struct creator_bucket {
+	struct creation_array projects;
+	char name[];
+};
+
+static struct {
+	bool built;
+	struct creation_array projects;  // only those with a known creation time
+} by_time;
+
+static mowgli_patricia_t *by_creator;
+
+// Total order on (time, name); a NULL name comes before all others of its time
+static int creation_cmp(const time_t t1, const char * const n1, const time_t t2, const char * const n2)
+{
+	if (t1 != t2)
+		return t1 < t2 ? -1 : 1;
+	if (!n1 || !n2)
+		return n1 ? 1 : (n2 ? -1 : 0);
+	return strcasecmp(n1, n2);
+}
+
+static size_t creation_lower_bound(const struct creation_array * const a, const time_t time, const char * const name)
+{
+	size_t lo = 0, hi = a->count;
+
+	while (lo < hi)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (creation_cmp(a->entries[mid].time, a->entries[mid].project->name, time, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void creation_array_append(struct creation_array * const a, struct projectns * const p)
+{
+	if (a->count == a->size)
+	{
+		a->size    = a->size ? a->size * 2 : 16;
+		a->entries = srealloc(a->entries, a->size * sizeof *a->entries);
+	}
+
+	a->entries[a->count].time    = p->creation_time;
+	a->entries[a->count].project = p;
+	a->count++;
+}
+
+static void creation_array_add(struct creation_array * const a, struct projectns * const p)
+{
+	const size_t pos = creation_lower_bound(a, p->creation_time, p->name);
+
+	creation_array_append(a, p);
+	memmove(&a->entries[pos + 1], &a->entries[pos], (a->count - 1 - pos) * sizeof *a->entries);
+	a->entries[pos].time    = p->creation_time;
+	a->entries[pos].project = p;
+}
+
+static void creation_array_delete(struct creation_array * const a, struct projectns * const p)
+{
+	const size_t pos = creation_lower_bound(a, p->creation_time, p->name);
+
+	if (pos == a->count || a->entries[pos].project != p)
+		return;
+
+	memmove(&a->entries[pos], &a->entries[pos + 1], (a->count - pos - 1) * sizeof *a->entries);
+	a->count--;
+}
+
+static int creation_entry_cmp(const void *a, const void *b)
+{
+	const struct creation_entry *e1 = a, *e2 = b;
+
+	return creation_cmp(e1->time, e1->project->name, e2->time, e2->project->name);
+}
+
+static void creation_array_sort(struct creation_array * const a)
+{
+	qsort(a->entries, a->count, sizeof *a->entries, creation_entry_cmp);
+}
+
+static struct creator_bucket *creator_bucket_get(const char * const creator)
+{
+	struct creator_bucket *b = mowgli_patricia_retrieve(by_creator, creator);
+
+	if (!b)
+	{
+		const size_t len = strlen(creator) + 1;
+		b = smalloc(sizeof *b + len);
+		memset(&b->projects, 0, sizeof b->projects);
+		memcpy(b->name, creator, len);
+		mowgli_patricia_add(by_creator, b->name, b);
+	}
+
+	return b;
+}
+
+// Adds p to both indexes, which have to have been built
+static void creation_index_add(struct projectns * const p)
+{
+	if (p->creation_time)
+		creation_array_add(&by_time.projects, p);
+
+	if (p->creator)
+		creation_array_add(&creator_bucket_get(p->creator)->projects, p);
+}
+
+static void creation_index_delete(struct projectns * const p)
+{
+	if (p->creation_time)
+		creation_array_delete(&by_time.projects, p);
+
+	if (!p->creator)
+		return;
+
+	struct creator_bucket *b = mowgli_patricia_retrieve(by_creator, p->creator);
+	if (!b)
+		return;
+
+	creation_array_delete(&b->projects, p);
+	if (!b->projects.count)
+	{
+		mowgli_patricia_delete(by_creator, b->name);
+		free(b->projects.entries);
+		free(b);
+	}
+}
+
+static void creation_index_build(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+	struct creator_bucket *b;
+
+	if (by_time.built)
+		return;
+
+	by_time.projects.size    = mowgli_patricia_size(projectsvs.projects) + 256;
+	by_time.projects.entries = smalloc(by_time.projects.size * sizeof *by_time.projects.entries);
+	by_time.projects.count   = 0;
+	by_creator               = mowgli_patricia_create(strcasecanon);
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+	{
+		if (p->creation_time)
+			creation_array_append(&by_time.projects, p);
+
+		if (p->creator)
+			creation_array_append(&creator_bucket_get(p->creator)->projects, p);
+	}
+
+	creation_array_sort(&by_time.projects);
+	MOWGLI_PATRICIA_FOREACH(b, &state, by_creator)
+		creation_array_sort(&b->projects);
+
+	by_time.built = true;
+}
+
+static void free_bucket_cb(const char *key, void *data, void *privdata)
+{
+	struct creator_bucket * const b = data;
+
+	free(b->projects.entries);
+	free(b);
+}
+
+// Drops both indexes; the next query rebuilds them
+void creation_index_reset(void)
+{
+	if (!by_time.built)
+		return;
+
+	free(by_time.projects.entries);
+	memset(&by_time.projects, 0, sizeof by_time.projects);
+	by_time.built = false;
+
+	mowgli_patricia_destroy(by_creator, free_bucket_cb, NULL);
+	by_creator = NULL;
+}
+
+// Registration details have to be set through here for the indexes to notice
+void project_set_creation(struct projectns * const p, const time_t time, const char * const creator)
+{
+	if (by_time.built)
+		creation_index_delete(p);
+
+	p->creation_time = time;
+	strshare_unref(p->creator);
+	p->creator = creator ? strshare_get(creator) : NULL;
+
+	if (by_time.built)
+		creation_index_add(p);
+
+	project_touch(p);
+}
+
+// Zero while the indexes have not been built
+size_t creation_index_bytes(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct creator_bucket *b;
+
+	if (!by_time.built)
+		return 0;
+
+	size_t bytes = by_time.projects.size * sizeof *by_time.projects.entries;
+
+	MOWGLI_PATRICIA_FOREACH(b, &state, by_creator)
+		bytes += sizeof *b + strlen(b->name) + 1 + b->projects.size * sizeof *b->projects.entries;
+
+	return bytes;
+}
+
+// Takes p out of the indexes, before it is destroyed or renamed
+void creation_index_forget(struct projectns * const p)
+{
+	if (by_time.built)
+		creation_index_delete(p);
+}
+
+// Puts p back into the indexes after a rename
+void creation_index_restore(struct projectns * const p)
+{
+	if (by_time.built)
+		creation_index_add(p);
+}
+
+/* Calls cb for every project created at or after after and, if before is
+ * nonzero, before before, in order of creation time and then name, until cb
+ * returns nonzero. With a creator, only that oper's registrations are visited;
+ * with a from_name, only those ordered after (from_time, from_name). Projects
+ * of unknown age never match a time bound. Returns the number visited.
+ */
+unsigned int projects_by_creation(const time_t after, const time_t before, const char * const creator,
+                                  const time_t from_time, const char * const from_name,
+                                  int (*cb)(struct projectns *p, void *privdata), void *privdata)
+{
+	const struct creation_array *a = &by_time.projects;
+	unsigned int visited = 0;
+
+	creation_index_build();
+
+	if (creator)
+	{
+		const struct creator_bucket * const b = mowgli_patricia_retrieve(by_creator, creator);
+		if (!b)
+			return 0;
+		a = &b->projects;
+	}
+
+	size_t i = creation_lower_bound(a, after, NULL);
+
+	if (from_name && creation_cmp(from_time, from_name, after, NULL) >= 0)
+	{
+		i = creation_lower_bound(a, from_time, from_name);
+		if (i < a->count && creation_cmp(a->entries[i].time, a->entries[i].project->name, from_time, from_name) == 0)
+			i++;
+	}
+
+	for (; i < a->count; i++)
+	{
+		const struct creation_entry * const e = &a->entries[i];
+
+		if (before && e->time >= before)
+			break;
+		// only in the creator buckets, where they come first
+		if (before && !e->time)
+			continue;
+
+		visited++;
+		if (cb(e->project, privdata))
+			break;
+	}
+
+	return visited;
+}
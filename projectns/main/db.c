@@ -9,36 +9,33 @@
 #include "fn-compat.h"
 #include "main.h"
 
-#define DB_TYPE_PROJECT           "FNGROUP"
-#define DB_TYPE_REGINFO           "FNGRI"
-#define DB_TYPE_CONTACT           "FNGC"
-#define DB_TYPE_CHANNEL_NAMESPACE "FNCNS"
-#define DB_TYPE_CLOAK_NAMESPACE   "FNHNS"
-#define DB_TYPE_MARK              "FNGM"
-
 // Reading from the database
 static void db_h_project(database_handle_t *db, const char *type)
 {
 	const char *name     = db_sread_word(db);
 	unsigned int any_reg = db_sread_uint(db);
 
-	struct projectns *l = smalloc(sizeof(*l));
-	l->name = sstrdup(name);
-	l->any_may_register = any_reg;
+	// Journal records carry a full image of the project, replacing any earlier one
+	struct projectns *old = mowgli_patricia_retrieve(projectsvs.projects, name);
+	if (old)
+		project_destroy(old);
 
-	mowgli_patricia_add(projectsvs.projects, l->name, l);
+	struct projectns *l = project_new(name);
+	l->any_may_register = any_reg;
 
 	time_t regts;
-	if (db_read_time(db, &regts))
-		l->creation_time = regts;
-	else
+	if (!db_read_time(db, &regts))
 		return;
 
 	const char *creator = db_read_word(db);
-	if (creator && strcmp(creator, "*") != 0)
-		l->creator = strshare_get(creator);
-	else
+	project_set_creation(l, regts, creator && strcmp(creator, "*") != 0 ? creator : NULL);
+	if (!creator)
 		return;
+
+	// absent in older databases; the mark rows then tell us the highest ID used
+	unsigned int last_mark_id;
+	if (db_read_uint(db, &last_mark_id))
+		l->last_mark_id = last_mark_id;
 }
 
 static void db_h_reginfo(database_handle_t *db, const char *type)
@@ -62,14 +59,8 @@ static void db_h_mark(database_handle_t *db, const char *type)
 	const char *text = db_sread_str(db);
 
 	struct projectns *project = mowgli_patricia_retrieve(projectsvs.projects, name);
-	struct project_mark *mark = smalloc(sizeof *mark);
-	mark->number = num;
-	mark->time   = time;
-	mark->mark   = sstrdup(text);
-	mark->setter_id   = sstrdup(setter_id);
-	mark->setter_name = sstrdup(setter_name);
-
-	mowgli_node_add(mark, mowgli_node_create(), &project->marks);
+	if (!mark_new(project, num, time, setter_id, setter_name, text))
+		slog(LG_ERROR, "db_h_mark(): ignoring duplicate mark \2%u\2 for project \2%s\2", num, name);
 }
 
 static void db_h_contact(database_handle_t *db, const char *type)
@@ -80,12 +71,18 @@ static void db_h_contact(database_handle_t *db, const char *type)
 	struct projectns *project = mowgli_patricia_retrieve(projectsvs.projects, project_name);
 	myuser_t *mu = myuser_find(contact_name);
 
-	struct project_contact *contact = smalloc(sizeof *contact);
-	contact->project = project;
-	contact->mu      = mu;
+	if (!mu)
+	{
+		slog(LG_ERROR, "db_h_contact(): ignoring contact for nonexistent account \2%s\2 on project \2%s\2", contact_name, project_name);
+		return;
+	}
 
-	mowgli_node_add(contact, &contact->myuser_n,  myuser_get_projects(mu));
-	mowgli_node_add(contact, &contact->project_n, &project->contacts);
+	struct project_contact *contact = contact_new(project, mu);
+	if (!contact)
+	{
+		slog(LG_ERROR, "db_h_contact(): ignoring duplicate contact \2%s\2 for project \2%s\2", contact_name, project_name);
+		return;
+	}
 
 	unsigned int visible, secondary;
 
@@ -107,8 +104,7 @@ static void db_h_channelns(database_handle_t *db, const char *type)
 
 	struct projectns *project = mowgli_patricia_retrieve(projectsvs.projects, project_name);
 
-	mowgli_patricia_add(projectsvs.projects_by_channelns, namespace, project);
-	mowgli_node_add(sstrdup(namespace), mowgli_node_create(), &project->channel_ns);
+	channelns_add(project, namespace);
 }
 
 static void db_h_cloakns(database_handle_t *db, const char *type)
@@ -118,74 +114,168 @@ static void db_h_cloakns(database_handle_t *db, const char *type)
 
 	struct projectns *project = mowgli_patricia_retrieve(projectsvs.projects, project_name);
 
-	mowgli_patricia_add(projectsvs.projects_by_cloakns, namespace, project);
-	mowgli_node_add(sstrdup(namespace), mowgli_node_create(), &project->cloak_ns);
+	cloakns_add(project, namespace);
+}
+
+static void db_h_project_drop(database_handle_t *db, const char *type)
+{
+	const char *name = db_sread_word(db);
+
+	struct projectns *project = mowgli_patricia_retrieve(projectsvs.projects, name);
+	if (project)
+		project_destroy(project);
+}
+
+static void db_h_journal_seq(database_handle_t *db, const char *type)
+{
+	journal_state.loaded_seq = db_sread_uint(db);
 }
 
 // Writing to the database
-static void write_projects_db(database_handle_t *db)
+static void db_row_start(void *h, const char *type)
+{
+	db_start_row(h, type);
+}
+
+static void db_row_word(void *h, const char *word)
+{
+	db_write_word(h, word);
+}
+
+static void db_row_str(void *h, const char *str)
 {
-	mowgli_patricia_iteration_state_t state;
-	struct projectns *project;
+	db_write_str(h, str);
+}
+
+static void db_row_uint(void *h, unsigned int num)
+{
+	db_write_uint(h, num);
+}
 
-	MOWGLI_PATRICIA_FOREACH(project, &state, projectsvs.projects)
+static void db_row_time(void *h, time_t time)
+{
+	db_write_time(h, time);
+}
+
+static void db_row_commit(void *h)
+{
+	db_commit_row(h);
+}
+
+const struct row_writer db_row_writer = {
+	.start_row  = db_row_start,
+	.write_word = db_row_word,
+	.write_str  = db_row_str,
+	.write_uint = db_row_uint,
+	.write_time = db_row_time,
+	.commit_row = db_row_commit,
+};
+
+// Emits every row describing a single project; returns the number of rows written
+unsigned int write_project_rows(const struct row_writer * const w, void * const h, struct projectns * const project)
+{
+	unsigned int rows = 0;
+
+	w->start_row(h, DB_TYPE_PROJECT);
+	w->write_word(h, project->name);
+	w->write_uint(h, project->any_may_register);
+	w->write_time(h, project->creation_time);
+	w->write_word(h, project->creator);
+	w->write_uint(h, project->last_mark_id);
+	w->commit_row(h);
+	rows++;
+
+	if (project->reginfo)
 	{
-		db_start_row(db, DB_TYPE_PROJECT);
-		db_write_word(db, project->name);
-		db_write_uint(db, project->any_may_register);
-		db_write_time(db, project->creation_time);
-		db_write_word(db, project->creator);
-		db_commit_row(db);
-
-		if (project->reginfo)
-		{
-			db_start_row(db, DB_TYPE_REGINFO);
-			db_write_word(db, project->name);
-			db_write_str(db, project->reginfo);
-			db_commit_row(db);
-		}
+		w->start_row(h, DB_TYPE_REGINFO);
+		w->write_word(h, project->name);
+		w->write_str(h, project->reginfo);
+		w->commit_row(h);
+		rows++;
+	}
 
-		mowgli_node_t *n;
-		MOWGLI_ITER_FOREACH(n, project->marks.head)
-		{
-			struct project_mark *mark = n->data;
-			db_start_row(db, DB_TYPE_MARK);
-			db_write_word(db, project->name);
-			db_write_uint(db, mark->number);
-			db_write_time(db, mark->time);
-			db_write_word(db, mark->setter_id);
-			db_write_word(db, mark->setter_name);
-			db_write_str(db, mark->mark);
-			db_commit_row(db);
-		}
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, project->marks.head)
+	{
+		struct project_mark *mark = n->data;
+		w->start_row(h, DB_TYPE_MARK);
+		w->write_word(h, project->name);
+		w->write_uint(h, mark->number);
+		w->write_time(h, mark->time);
+		w->write_word(h, mark->setter_id);
+		w->write_word(h, mark->setter_name);
+		w->write_str(h, mark->mark);
+		w->commit_row(h);
+		rows++;
+	}
 
-		MOWGLI_ITER_FOREACH(n, project->contacts.head)
-		{
-			struct project_contact *contact = n->data;
-			db_start_row(db, DB_TYPE_CONTACT);
-			db_write_word(db, project->name);
-			db_write_word(db, ((myentity_t*)contact->mu)->name);
-			db_write_uint(db, contact->visible);
-			db_write_uint(db, contact->secondary);
-			db_commit_row(db);
-		}
+	MOWGLI_ITER_FOREACH(n, project->contacts.head)
+	{
+		struct project_contact *contact = n->data;
+		w->start_row(h, DB_TYPE_CONTACT);
+		w->write_word(h, project->name);
+		w->write_word(h, ((myentity_t*)contact->mu)->name);
+		w->write_uint(h, contact->visible);
+		w->write_uint(h, contact->secondary);
+		w->commit_row(h);
+		rows++;
+	}
 
-		MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
-		{
-			db_start_row(db, DB_TYPE_CHANNEL_NAMESPACE);
-			db_write_word(db, project->name);
-			db_write_word(db, (char*)n->data);
-			db_commit_row(db);
-		}
+	MOWGLI_ITER_FOREACH(n, project->channel_ns.head)
+	{
+		w->start_row(h, DB_TYPE_CHANNEL_NAMESPACE);
+		w->write_word(h, project->name);
+		w->write_word(h, (char*)n->data);
+		w->commit_row(h);
+		rows++;
+	}
 
-		MOWGLI_ITER_FOREACH(n, project->cloak_ns.head)
+	MOWGLI_ITER_FOREACH(n, project->cloak_ns.head)
+	{
+		w->start_row(h, DB_TYPE_CLOAK_NAMESPACE);
+		w->write_word(h, project->name);
+		w->write_word(h, (char*)n->data);
+		w->commit_row(h);
+		rows++;
+	}
+
+	return rows;
+}
+
+struct db_write_stats db_write_stats;
+
+static void write_projects_db(database_handle_t *db)
+{
+	struct timespec start, end;
+	const unsigned int journal_records = journal_state.records;
+	unsigned int rows = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// In journal mode the registry is kept in its own snapshot and journal files
+	const bool journal = journal_save();
+
+	if (journal)
+	{
+		rows = journal_state.records - journal_records;
+	}
+	else
+	{
+		mowgli_patricia_iteration_state_t state;
+		struct projectns *project;
+
+		MOWGLI_PATRICIA_FOREACH(project, &state, projectsvs.projects)
 		{
-			db_start_row(db, DB_TYPE_CLOAK_NAMESPACE);
-			db_write_word(db, project->name);
-			db_write_word(db, (char*)n->data);
-			db_commit_row(db);
+			rows += write_project_rows(&db_row_writer, db, project);
 		}
 	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	db_write_stats.time        = CURRTIME;
+	db_write_stats.duration_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	db_write_stats.rows        = rows;
+	db_write_stats.journal     = journal;
 }
 
 void init_db (void)
@@ -196,6 +286,8 @@ void init_db (void)
 	db_register_type_handler(DB_TYPE_CONTACT, db_h_contact);
 	db_register_type_handler(DB_TYPE_CHANNEL_NAMESPACE, db_h_channelns);
 	db_register_type_handler(DB_TYPE_CLOAK_NAMESPACE, db_h_cloakns);
+	db_register_type_handler(DB_TYPE_PROJECT_DROP, db_h_project_drop);
+	db_register_type_handler(DB_TYPE_JOURNAL_SEQ, db_h_journal_seq);
 
 	hook_add_db_write(write_projects_db);
 }
@@ -208,6 +300,8 @@ void deinit_db (void)
 	db_unregister_type_handler(DB_TYPE_CONTACT);
 	db_unregister_type_handler(DB_TYPE_CHANNEL_NAMESPACE);
 	db_unregister_type_handler(DB_TYPE_CLOAK_NAMESPACE);
+	db_unregister_type_handler(DB_TYPE_PROJECT_DROP);
+	db_unregister_type_handler(DB_TYPE_JOURNAL_SEQ);
 
 	hook_del_db_write(write_projects_db);
 }
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Incremental JSON export of the registry
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Writes the registry as newline-delimited JSON, one array per database row:
+ *
+ *   ["FNGROUP","Project",0,1546300800,"oper",2]
+ *   ["FNGC","Project","account",1,0]
+ *
+ * The rows are exactly those write_project_rows() produces for services.db, with
+ * absent words as null. The export runs in slices of EXPORT_SLICE projects, one
+ * per event loop iteration, and resumes by name from the key index, so projects
+ * changing or disappearing in between cannot break it. Output goes to a
+ * temporary file that is only renamed into place once complete.
+ */
+
+#define EXPORT_SLICE      256U
+#define EXPORT_BUFFER     65536U
+
+static struct {
+	FILE *file;
+	char *path;
+	char *tmppath;
+	char *requester;
+	char last[PROJECTNAMELEN + 1];  // resume after this project
+	unsigned int projects;
+	unsigned int rows;
+	unsigned int slices;
+	unsigned int slice_left;
+	struct timespec start;
+	mowgli_eventloop_timer_t *timer;
+} export_job;
+
+// Length of the well-formed UTF-8 sequence at s, or 0 if there is none
+static size_t utf8_sequence(const unsigned char * const s)
+{
+	size_t len;
+	unsigned char min = 0x80, max = 0xbf;
+
+	if (s[0] < 0x80)
+		return 1;
+	else if (s[0] >= 0xc2 && s[0] <= 0xdf)
+		len = 2;
+	else if (s[0] >= 0xe0 && s[0] <= 0xef)
+	{
+		len = 3;
+		if (s[0] == 0xe0)
+			min = 0xa0;  // overlong
+		else if (s[0] == 0xed)
+			max = 0x9f;  // surrogates
+	}
+	else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+	{
+		len = 4;
+		if (s[0] == 0xf0)
+			min = 0x90;  // overlong
+		else if (s[0] == 0xf4)
+			max = 0x8f;  // beyond U+10FFFF
+	}
+	else
+		return 0;
+
+	if (s[1] < min || s[1] > max)
+		return 0;
+
+	for (size_t i = 2; i < len; i++)
+		if (s[i] < 0x80 || s[i] > 0xbf)
+			return 0;
+
+	return len;
+}
+
+/* Reginfo, marks and setter names may be in any encoding, but the output has
+ * to be valid UTF-8. Bytes not part of a well-formed sequence are taken as
+ * Latin-1 and escaped, which keeps the commonest legacy text readable.
+ */
+static void json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+
+	while (*s)
+	{
+		const unsigned char c = (unsigned char)*s;
+		const size_t len = utf8_sequence((const unsigned char *)s);
+
+		if (c == '"' || c == '\\')
+		{
+			fputc('\\', f);
+			fputc(c, f);
+		}
+		else if (c < 0x20 || c == 0x7f || !len)
+			fprintf(f, "\\u%04x", c);
+		else
+		{
+			fwrite(s, 1, len, f);
+			s += len;
+			continue;
+		}
+
+		s++;
+	}
+
+	fputc('"', f);
+}
+
+static void json_row_start(void *h, const char *type)
+{
+	fputc('[', h);
+	json_string(h, type);
+}
+
+static void json_row_word(void *h, const char *word)
+{
+	fputc(',', h);
+	if (word)
+		json_string(h, word);
+	else
+		fputs("null", h);
+}
+
+static void json_row_str(void *h, const char *str)
+{
+	fputc(',', h);
+	json_string(h, str);
+}
+
+static void json_row_uint(void *h, unsigned int num)
+{
+	fprintf(h, ",%u", num);
+}
+
+static void json_row_time(void *h, time_t time)
+{
+	fprintf(h, ",%lu", (unsigned long)time);
+}
+
+static void json_row_commit(void *h)
+{
+	fputs("]\n", h);
+}
+
+static const struct row_writer json_row_writer = {
+	.start_row  = json_row_start,
+	.write_word = json_row_word,
+	.write_str  = json_row_str,
+	.write_uint = json_row_uint,
+	.write_time = json_row_time,
+	.commit_row = json_row_commit,
+};
+
+static void export_cleanup(void)
+{
+	if (export_job.timer)
+		mowgli_timer_destroy(base_eventloop, export_job.timer);
+
+	free(export_job.path);
+	free(export_job.tmppath);
+	free(export_job.requester);
+	memset(&export_job, 0, sizeof export_job);
+}
+
+static void export_abort(const char * const reason)
+{
+	slog(LG_ERROR, "freenode/projectns/main: export to %s failed: %s", export_job.path, reason);
+
+	if (export_job.file)
+		fclose(export_job.file);
+	unlink(export_job.tmppath);
+
+	export_cleanup();
+}
+
+static int export_project_cb(const char *key, void *data, void *privdata)
+{
+	if (!export_job.slice_left)
+		return 1;
+
+	export_job.rows += write_project_rows(&json_row_writer, export_job.file, data);
+	export_job.projects++;
+	export_job.slice_left--;
+	mowgli_strlcpy(export_job.last, key, sizeof export_job.last);
+
+	return 0;
+}
+
+static void export_slice(void *unused)
+{
+	export_job.timer = NULL;
+	export_job.slice_left = EXPORT_SLICE;
+	export_job.slices++;
+
+	projects_foreach_prefix("", export_job.projects ? export_job.last : NULL, export_project_cb, NULL);
+
+	if (ferror(export_job.file))
+	{
+		export_abort(strerror(errno));
+		return;
+	}
+
+	// stopped early, so there is more to do
+	if (!export_job.slice_left)
+	{
+		export_job.timer = mowgli_timer_add_once(base_eventloop, "projectns_export", export_slice, NULL, 0);
+		return;
+	}
+
+	FILE *f = export_job.file;
+	export_job.file = NULL;
+
+	if (fclose(f) != 0)
+	{
+		export_abort(strerror(errno));
+		return;
+	}
+
+	if (rename(export_job.tmppath, export_job.path) != 0)
+	{
+		export_abort(strerror(errno));
+		return;
+	}
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	slog(LG_INFO, "freenode/projectns/main: exported %u projects (%u rows) to %s for %s in %u slices, %.3f ms",
+	     export_job.projects, export_job.rows, export_job.path, export_job.requester, export_job.slices,
+	     (end.tv_sec - export_job.start.tv_sec) * 1e3 + (end.tv_nsec - export_job.start.tv_nsec) / 1e6);
+
+	export_cleanup();
+}
+
+bool export_running(void)
+{
+	return export_job.path != NULL;
+}
+
+/* Starts exporting to the given file in the data directory. Returns false with
+ * errno set if the file cannot be created; otherwise the outcome is logged.
+ */
+bool export_start(const char * const filename, const char * const requester)
+{
+	char path[BUFSIZE];
+
+	if (!is_valid_data_file_name(filename, PROJECT_EXPORT_SUFFIX))
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	if (export_running())
+	{
+		errno = EBUSY;
+		return false;
+	}
+
+	snprintf(path, sizeof path, "%s/%s", DATADIR, filename);
+	export_job.path = sstrdup(path);
+	snprintf(path, sizeof path, "%s/%s.new", DATADIR, filename);
+	export_job.tmppath = sstrdup(path);
+
+	export_job.file = fopen(export_job.tmppath, "w");
+	if (!export_job.file)
+	{
+		const int err = errno;
+		export_cleanup();
+		errno = err;
+		return false;
+	}
+
+	setvbuf(export_job.file, NULL, _IOFBF, EXPORT_BUFFER);
+
+	export_job.requester = sstrdup(requester);
+	clock_gettime(CLOCK_MONOTONIC, &export_job.start);
+	export_job.timer = mowgli_timer_add_once(base_eventloop, "projectns_export", export_slice, NULL, 0);
+
+	return true;
+}
+
+void deinit_export(void)
+{
+	if (export_running())
+		export_abort("module unloaded");
+}
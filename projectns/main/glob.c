@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Precompiled match() patterns
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* A pattern is split at its '*'s into segments, which are stored case-folded
+ * the way match() folds them. Matching first rejects names that are too short,
+ * then checks the anchored segments at either end, and only then searches for
+ * the floating ones, each at the leftmost position after the previous one.
+ * Leftmost placement is always safe as nothing but '*' separates segments.
+ */
+
+struct glob_segment {
+	const char *text;  // folded; '?' matches any character
+	size_t len;
+	int first_byte;    // for memchr when text[0] has no other case, otherwise -1
+};
+
+struct compiled_glob {
+	bool has_star;
+	bool anchored_start;
+	bool anchored_end;
+	size_t min_len;
+	size_t nsegs;
+	char *text;
+	struct glob_segment segs[];
+};
+
+static inline bool segment_at(const struct glob_segment * const seg, const char * const s)
+{
+	for (size_t i = 0; i < seg->len; i++)
+		if (seg->text[i] != '?' && seg->text[i] != (char)ToLower(s[i]))
+			return false;
+
+	return true;
+}
+
+// Leftmost occurrence of seg in the len bytes at s
+static const char *segment_find(const struct glob_segment * const seg, const char *s, size_t len)
+{
+	const char * const end = s + len;
+
+	while ((size_t)(end - s) >= seg->len)
+	{
+		if (seg->first_byte >= 0)
+		{
+			s = memchr(s, seg->first_byte, end - s - seg->len + 1);
+			if (!s)
+				return NULL;
+		}
+
+		if (segment_at(seg, s))
+			return s;
+
+		s++;
+	}
+
+	return NULL;
+}
+
+// Whether c is the only byte folding to itself, so it can be searched for as-is
+static bool fold_is_unique(const unsigned char c)
+{
+	if (c == '?' || (unsigned char)ToLower(c) != c)
+		return false;
+
+	for (unsigned int b = 0; b <= UCHAR_MAX; b++)
+		if (b != c && (unsigned char)ToLower(b) == c)
+			return false;
+
+	return true;
+}
+
+struct compiled_glob *glob_compile(const char * const pattern)
+{
+	const size_t len = strlen(pattern);
+	size_t nsegs = 0;
+
+	for (size_t i = 0; i < len; i++)
+		if (pattern[i] != '*' && (i == 0 || pattern[i - 1] == '*'))
+			nsegs++;
+
+	struct compiled_glob *g = scalloc(1, sizeof *g + nsegs * sizeof g->segs[0]);
+	g->text = smalloc(len + 1);
+	g->nsegs = 0;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		if (pattern[i] == '*')
+		{
+			g->has_star = true;
+			g->text[i] = '*';
+			continue;
+		}
+
+		g->text[i] = pattern[i] == '?' ? '?' : (char)ToLower(pattern[i]);
+
+		if (i == 0 || pattern[i - 1] == '*')
+			g->segs[g->nsegs++].text = &g->text[i];
+		g->segs[g->nsegs - 1].len++;
+		g->min_len++;
+	}
+	g->text[len] = '\0';
+
+	g->anchored_start = len && pattern[0] != '*';
+	g->anchored_end   = len && pattern[len - 1] != '*';
+
+	for (size_t i = 0; i < g->nsegs; i++)
+		g->segs[i].first_byte = fold_is_unique(g->segs[i].text[0]) ? (unsigned char)g->segs[i].text[0] : -1;
+
+	return g;
+}
+
+void glob_free(struct compiled_glob * const g)
+{
+	if (!g)
+		return;
+
+	free(g->text);
+	free(g);
+}
+
+// Same result as !match(pattern, name) for the pattern g was compiled from
+bool glob_match(const struct compiled_glob * const g, const char * const name)
+{
+	const size_t len = strlen(name);
+
+	if (len < g->min_len)
+		return false;
+
+	if (!g->has_star)
+		return len == g->min_len && (!g->nsegs || segment_at(&g->segs[0], name));
+
+	const char *start = name, *end = name + len;
+	size_t first = 0, last = g->nsegs;
+
+	// a '*' strictly inside the pattern means these are two different segments
+	if (g->anchored_end)
+	{
+		const struct glob_segment *seg = &g->segs[--last];
+		end -= seg->len;
+		if (!segment_at(seg, end))
+			return false;
+	}
+
+	if (g->anchored_start)
+	{
+		const struct glob_segment *seg = &g->segs[first++];
+		if (!segment_at(seg, start))
+			return false;
+		start += seg->len;
+	}
+
+	for (size_t i = first; i < last; i++)
+	{
+		start = segment_find(&g->segs[i], start, end - start);
+		if (!start)
+			return false;
+		start += g->segs[i].len;
+	}
+
+	return true;
+}
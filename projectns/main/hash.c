@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Pointer-keyed hash tables
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Open addressing with linear probing. Deletion shifts later entries of the
+ * same probe run backwards instead of leaving tombstones, so lookups never
+ * have to skip over dead slots.
+ */
+
+#define PTRHASH_MIN_SIZE 64U
+
+static inline size_t ptrhash_slot(const struct ptrhash *const h, const void *const k1, const void *const k2)
+{
+	uint64_t x = (uint64_t)(uintptr_t)k1 * UINT64_C(0x9E3779B97F4A7C15);
+	x ^= (uint64_t)(uintptr_t)k2 * UINT64_C(0xC2B2AE3D27D4EB4F);
+	x ^= x >> 29;
+
+	return (size_t)x & (h->size - 1);
+}
+
+static void ptrhash_resize(struct ptrhash *const h, const size_t size)
+{
+	struct ptrhash_entry *const old = h->table;
+	const size_t old_size = h->size;
+
+	h->table = scalloc(size, sizeof *h->table);
+	h->size  = size;
+	h->count = 0;
+
+	for (size_t i = 0; i < old_size; i++)
+		if (old[i].k1)
+			ptrhash_put(h, old[i].k1, old[i].k2, old[i].value);
+
+	free(old);
+}
+
+void ptrhash_init(struct ptrhash *const h)
+{
+	h->table = NULL;
+	h->size  = 0;
+	h->count = 0;
+}
+
+void ptrhash_destroy(struct ptrhash *const h)
+{
+	free(h->table);
+	ptrhash_init(h);
+}
+
+void *ptrhash_get(const struct ptrhash *const h, const void *const k1, const void *const k2)
+{
+	if (!h->count || !k1)
+		return NULL;
+
+	for (size_t i = ptrhash_slot(h, k1, k2); h->table[i].k1; i = (i + 1) & (h->size - 1))
+	{
+		if (h->table[i].k1 == k1 && h->table[i].k2 == k2)
+			return h->table[i].value;
+	}
+
+	return NULL;
+}
+
+// k1 must not be NULL; an existing entry for the same keys is replaced
+void ptrhash_put(struct ptrhash *const h, const void *const k1, const void *const k2, void *const value)
+{
+	// keep the load factor at or below 1/2
+	if ((h->count + 1) * 2 > h->size)
+		ptrhash_resize(h, h->size ? h->size * 2 : PTRHASH_MIN_SIZE);
+
+	size_t i;
+	for (i = ptrhash_slot(h, k1, k2); h->table[i].k1; i = (i + 1) & (h->size - 1))
+	{
+		if (h->table[i].k1 == k1 && h->table[i].k2 == k2)
+		{
+			h->table[i].value = value;
+			return;
+		}
+	}
+
+	h->table[i].k1    = k1;
+	h->table[i].k2    = k2;
+	h->table[i].value = value;
+	h->count++;
+}
+
+void *ptrhash_delete(struct ptrhash *const h, const void *const k1, const void *const k2)
+{
+	if (!h->count || !k1)
+		return NULL;
+
+	const size_t mask = h->size - 1;
+	size_t i;
+
+	for (i = ptrhash_slot(h, k1, k2); h->table[i].k1; i = (i + 1) & mask)
+	{
+		if (h->table[i].k1 == k1 && h->table[i].k2 == k2)
+			break;
+	}
+
+	if (!h->table[i].k1)
+		return NULL;
+
+	void *const value = h->table[i].value;
+
+	// Backward-shift deletion: move up any entry whose probe run crosses the hole
+	for (size_t j = (i + 1) & mask; h->table[j].k1; j = (j + 1) & mask)
+	{
+		const size_t home = ptrhash_slot(h, h->table[j].k1, h->table[j].k2);
+
+		// entry at j may fill the hole at i unless its home lies cyclically in (i, j]
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			h->table[i] = h->table[j];
+			i = j;
+		}
+	}
+
+	h->table[i].k1    = NULL;
+	h->table[i].k2    = NULL;
+	h->table[i].value = NULL;
+	h->count--;
+
+	if (h->size > PTRHASH_MIN_SIZE && h->count * 8 < h->size)
+		ptrhash_resize(h, h->size / 2);
+
+	return value;
+}
+
+// Memory held by the table itself
+size_t ptrhash_bytes(const struct ptrhash *const h)
+{
+	return h->size * sizeof *h->table;
+}
@@ -0,0 +1,680 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Incremental database journal
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* With JOURNAL enabled, project rows are no longer written to services.db.
+ * Instead, the registry is kept as a snapshot file plus an append-only journal:
+ * every database save appends a full image of each project changed since the
+ * last save, preceded by FNGDROP rows discarding the images they replace, so a
+ * save costs only as much as what actually changed. Once the journal grows past
+ * JOURNAL_COMPACT rows it is folded into a fresh snapshot.
+ *
+ * The journal and the text snapshot use the same row format as services.db and
+ * are loaded through the regular database handlers. Compaction additionally
+ * writes a binary snapshot (see snapshot.c), which is preferred at startup as it
+ * loads in one pass; the text snapshot is the fallback if it is missing or
+ * unusable. Each snapshot and journal carries a sequence number; a journal is only
+ * replayed on top of the snapshot carrying the same sequence number, so a crash
+ * between writing a snapshot and truncating the journal cannot replay stale
+ * images over newer data.
+ *
+ * Compaction runs in slices of JOURNAL_COMPACT_SLICE projects, one per event
+ * loop iteration, resuming by name from the key index like an export does, so
+ * a large registry does not stall services while it is rewritten. Saves keep
+ * going to the old journal meanwhile. Projects changed or dropped after their
+ * slice was written are tracked separately and go into the new journal, which
+ * is written before either snapshot is renamed into place: if we crash after
+ * that, startup finds the new journal next to the new snapshots.
+ */
+
+#define JOURNAL_SNAPSHOT_PATH DATADIR "/projectns.db"
+#define JOURNAL_BINARY_PATH   DATADIR "/projectns.bin"
+#define JOURNAL_PATH          DATADIR "/projectns.journal"
+#define JOURNAL_SNAPSHOT_NEW_PATH JOURNAL_SNAPSHOT_PATH ".new"
+#define JOURNAL_NEW_PATH      JOURNAL_PATH ".new"
+
+#define JOURNAL_COMPACT_SLICE 256U
+
+struct journal_state journal_state;
+
+static FILE *journal_file;
+
+// projects changed since the last save
+static mowgli_list_t dirty_projects;
+static struct ptrhash dirty_index;
+
+// names whose stored images have to be discarded (dropped or renamed projects)
+static mowgli_patricia_t *dropped_names;
+
+static mowgli_eventloop_timer_t *journal_startup_timer;
+
+/* Nonzero if JOURNAL was off at startup but services.db had no projects, so
+ * they were loaded from the snapshot and journal instead. Counts down the
+ * services.db writes until those files go: the second write only starts after
+ * the first one, holding the registry again, has completed.
+ */
+static unsigned int retire_countdown;
+static mowgli_eventloop_timer_t *journal_compact_timer;
+
+static struct {
+	FILE *text;
+	struct snapshot_writer *binary;
+	unsigned int seq;
+	char last[PROJECTNAMELEN + 1];  // resume after this project
+	unsigned int projects;
+	unsigned int slices;
+	unsigned int slice_left;
+	double longest_slice;           // ms
+	struct timespec start;
+
+	// projects written already and changed since, and names written already and dropped since
+	mowgli_list_t stale_projects;
+	struct ptrhash stale_index;
+	mowgli_patricia_t *stale_names;
+} compact_job;
+
+// Row writer producing the same line format as the flatfile database backend
+static void file_row_start(void *h, const char *type)
+{
+	fputs(type, h);
+}
+
+static void file_row_word(void *h, const char *word)
+{
+	fprintf(h, " %s", word ? word : "*");
+}
+
+static void file_row_str(void *h, const char *str)
+{
+	fprintf(h, " %s", str);
+}
+
+static void file_row_uint(void *h, unsigned int num)
+{
+	fprintf(h, " %u", num);
+}
+
+static void file_row_time(void *h, time_t time)
+{
+	fprintf(h, " %lu", (unsigned long)time);
+}
+
+static void file_row_commit(void *h)
+{
+	fputc('\n', h);
+}
+
+const struct row_writer file_row_writer = {
+	.start_row  = file_row_start,
+	.write_word = file_row_word,
+	.write_str  = file_row_str,
+	.write_uint = file_row_uint,
+	.write_time = file_row_time,
+	.commit_row = file_row_commit,
+};
+
+static void project_set_add(mowgli_list_t * const l, struct ptrhash * const index, struct projectns * const p)
+{
+	if (ptrhash_get(index, p, NULL))
+		return;
+
+	mowgli_node_t *n = mowgli_node_create();
+	mowgli_node_add(p, n, l);
+	ptrhash_put(index, p, NULL, n);
+}
+
+static void project_set_remove(mowgli_list_t * const l, struct ptrhash * const index, struct projectns * const p)
+{
+	mowgli_node_t *n = ptrhash_delete(index, p, NULL);
+
+	if (n)
+	{
+		mowgli_node_delete(n, l);
+		mowgli_node_free(n);
+	}
+}
+
+static void project_set_clear(mowgli_list_t * const l, struct ptrhash * const index)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+	{
+		mowgli_node_delete(n, l);
+		mowgli_node_free(n);
+	}
+
+	ptrhash_destroy(index);
+}
+
+static void clear_dirty(void)
+{
+	project_set_clear(&dirty_projects, &dirty_index);
+	mowgli_patricia_destroy(dropped_names, NULL, NULL);
+	dropped_names = mowgli_patricia_create(strcasecanon);
+}
+
+static inline bool compaction_running(void)
+{
+	return compact_job.text != NULL;
+}
+
+// Whether a running compaction has already written this name to the new snapshots
+static inline bool compaction_passed(const char * const name)
+{
+	return compaction_running() && compact_job.projects && project_keys.cmp(name, compact_job.last) <= 0;
+}
+
+void journal_touch(struct projectns * const p)
+{
+	if (!projectsvs.config.journal)
+		return;
+
+	if (compaction_passed(p->name))
+		project_set_add(&compact_job.stale_projects, &compact_job.stale_index, p);
+
+	project_set_add(&dirty_projects, &dirty_index, p);
+}
+
+void journal_forget(struct projectns * const p)
+{
+	project_set_remove(&dirty_projects, &dirty_index, p);
+
+	if (compaction_running())
+	{
+		project_set_remove(&compact_job.stale_projects, &compact_job.stale_index, p);
+		if (compaction_passed(p->name))
+			mowgli_patricia_add(compact_job.stale_names, p->name, compact_job.stale_names);
+	}
+
+	if (projectsvs.config.journal)
+		mowgli_patricia_add(dropped_names, p->name, dropped_names);
+}
+
+void project_rename(struct projectns * const p, const char * const newname)
+{
+	char *oldname = p->name;
+
+	journal_forget(p);
+	creation_index_forget(p);
+
+	p->name = sstrdup(newname);
+	creation_index_restore(p);
+
+	// must be in this order or this will break if only casing is changed
+	mowgli_patricia_delete(projectsvs.projects, oldname);
+	mowgli_patricia_add(projectsvs.projects, p->name, p);
+	key_index_delete(&project_keys, oldname);
+	key_index_add(&project_keys, p->name, p);
+
+	project_touch(p);
+
+	free(oldname);
+}
+
+static bool journal_open(void)
+{
+	if (journal_file)
+		return true;
+
+	journal_file = fopen(JOURNAL_PATH, "a");
+	if (!journal_file)
+	{
+		slog(LG_ERROR, "freenode/projectns/main: cannot open %s: %s", JOURNAL_PATH, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static int write_drop_row(const char *key, void *data, void *privdata)
+{
+	file_row_writer.start_row(privdata, DB_TYPE_PROJECT_DROP);
+	file_row_writer.write_word(privdata, key);
+	file_row_writer.commit_row(privdata);
+	journal_state.records++;
+
+	return 0;
+}
+
+static void write_images(FILE * const f, mowgli_patricia_t * const dropped, const mowgli_list_t * const projects)
+{
+	mowgli_node_t *n;
+
+	/* Discard every stored image we are about to replace before adding any,
+	 * so namespaces that moved between two changed projects replay correctly.
+	 */
+	mowgli_patricia_foreach(dropped, write_drop_row, f);
+	MOWGLI_ITER_FOREACH(n, projects->head)
+	{
+		struct projectns *p = n->data;
+		write_drop_row(p->name, NULL, f);
+	}
+
+	MOWGLI_ITER_FOREACH(n, projects->head)
+	{
+		journal_state.records += write_project_rows(&file_row_writer, f, n->data);
+	}
+}
+
+// Appends the images of all changed projects to the journal
+static bool journal_flush(void)
+{
+	if (!dirty_projects.count && !mowgli_patricia_size(dropped_names))
+		return true;
+
+	if (!journal_open())
+		return false;
+
+	write_images(journal_file, dropped_names, &dirty_projects);
+
+	if (fflush(journal_file) != 0 || ferror(journal_file))
+	{
+		slog(LG_ERROR, "freenode/projectns/main: error writing %s: %s", JOURNAL_PATH, strerror(errno));
+		fclose(journal_file);
+		journal_file = NULL;
+		return false;
+	}
+
+	clear_dirty();
+	return true;
+}
+
+static void journal_compact_cb(void *unused);
+
+static void compaction_cleanup(void)
+{
+	project_set_clear(&compact_job.stale_projects, &compact_job.stale_index);
+	mowgli_patricia_destroy(compact_job.stale_names, NULL, NULL);
+	memset(&compact_job, 0, sizeof compact_job);
+}
+
+static void compaction_abort(const char * const reason)
+{
+	slog(LG_ERROR, "freenode/projectns/main: compacting the journal into snapshot %u failed: %s", compact_job.seq, reason);
+
+	if (compact_job.text)
+		fclose(compact_job.text);
+	unlink(JOURNAL_SNAPSHOT_NEW_PATH);
+	if (compact_job.binary)
+		snapshot_abort(compact_job.binary);
+	unlink(JOURNAL_NEW_PATH);
+
+	compaction_cleanup();
+}
+
+static int compact_project_cb(const char *key, void *data, void *privdata)
+{
+	if (!compact_job.slice_left)
+		return 1;
+
+	write_project_rows(&file_row_writer, compact_job.text, data);
+	snapshot_add_project(compact_job.binary, data);
+
+	compact_job.projects++;
+	compact_job.slice_left--;
+	mowgli_strlcpy(compact_job.last, key, sizeof compact_job.last);
+
+	return 0;
+}
+
+/* Writes the new journal, holding what changed behind the slices, and puts the
+ * snapshots and then the journal into place.
+ */
+static void compaction_finish(void)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	FILE *f = compact_job.text;
+	compact_job.text = NULL;
+
+	if (fflush(f) != 0 || ferror(f) || fsync(fileno(f)) != 0)
+	{
+		fclose(f);
+		compaction_abort(strerror(errno));
+		return;
+	}
+	fclose(f);
+
+	FILE *journal = fopen(JOURNAL_NEW_PATH, "w");
+	if (!journal)
+	{
+		compaction_abort(strerror(errno));
+		return;
+	}
+
+	const unsigned int old_records = journal_state.records;
+
+	journal_state.records = 0;
+	file_row_writer.start_row(journal, DB_TYPE_JOURNAL_SEQ);
+	file_row_writer.write_uint(journal, compact_job.seq);
+	file_row_writer.commit_row(journal);
+	write_images(journal, compact_job.stale_names, &compact_job.stale_projects);
+
+	if (fflush(journal) != 0 || ferror(journal))
+	{
+		journal_state.records = old_records;
+		fclose(journal);
+		compaction_abort(strerror(errno));
+		return;
+	}
+
+	// A failed binary snapshot is not fatal; startup falls back to the text one
+	if (!snapshot_finish(compact_job.binary))
+		unlink(JOURNAL_BINARY_PATH);
+	compact_job.binary = NULL;
+
+	if (rename(JOURNAL_SNAPSHOT_NEW_PATH, JOURNAL_SNAPSHOT_PATH) != 0 || rename(JOURNAL_NEW_PATH, JOURNAL_PATH) != 0)
+	{
+		slog(LG_ERROR, "freenode/projectns/main: cannot put snapshot %u into place: %s", compact_job.seq, strerror(errno));
+		fclose(journal);
+		journal_state.valid = false;
+		compaction_cleanup();
+		return;
+	}
+
+	if (journal_file)
+		fclose(journal_file);
+	journal_file = journal;
+
+	journal_state.seq   = compact_job.seq;
+	journal_state.valid = true;
+
+	// Whatever is still dirty has not been saved anywhere yet, so it stays for the next save
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	slog(LG_INFO, "freenode/projectns/main: compacted journal into snapshot %u: %u projects in %u slices "
+	     "(longest %.3f ms, writing out %.3f ms), %u rows carried over, %.3f ms in total",
+	     compact_job.seq, compact_job.projects, compact_job.slices, compact_job.longest_slice,
+	     (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6, journal_state.records,
+	     (end.tv_sec - compact_job.start.tv_sec) * 1e3 + (end.tv_nsec - compact_job.start.tv_nsec) / 1e6);
+
+	compaction_cleanup();
+}
+
+static void schedule_compaction(void)
+{
+	if (!journal_compact_timer)
+		journal_compact_timer = mowgli_timer_add_once(base_eventloop, "projectns_journal_compact", journal_compact_cb, NULL, 0);
+}
+
+static void compaction_slice(void)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	compact_job.slice_left = JOURNAL_COMPACT_SLICE;
+	compact_job.slices++;
+
+	projects_foreach_prefix("", compact_job.projects ? compact_job.last : NULL, compact_project_cb, NULL);
+
+	if (ferror(compact_job.text))
+	{
+		compaction_abort(strerror(errno));
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	const double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	if (ms > compact_job.longest_slice)
+		compact_job.longest_slice = ms;
+
+	// stopped early, so there is more to do
+	if (!compact_job.slice_left)
+		schedule_compaction();
+	else
+		compaction_finish();
+}
+
+// Starts writing the whole registry to a new snapshot, to be followed by a new journal
+static bool compaction_start(void)
+{
+	compact_job.text = fopen(JOURNAL_SNAPSHOT_NEW_PATH, "w");
+	if (!compact_job.text)
+	{
+		slog(LG_ERROR, "freenode/projectns/main: cannot write snapshot %s: %s", JOURNAL_SNAPSHOT_PATH, strerror(errno));
+		return false;
+	}
+
+	compact_job.seq    = journal_state.seq + 1;
+	compact_job.binary = snapshot_begin(JOURNAL_BINARY_PATH, compact_job.seq);
+	compact_job.stale_names = mowgli_patricia_create(strcasecanon);
+	ptrhash_init(&compact_job.stale_index);
+	clock_gettime(CLOCK_MONOTONIC, &compact_job.start);
+
+	file_row_writer.start_row(compact_job.text, DB_TYPE_JOURNAL_SEQ);
+	file_row_writer.write_uint(compact_job.text, compact_job.seq);
+	file_row_writer.commit_row(compact_job.text);
+
+	return true;
+}
+
+// Starts a compaction or continues the running one with its next slice
+static void journal_compact_cb(void *unused)
+{
+	journal_compact_timer = NULL;
+
+	if (!projectsvs.config.journal)
+	{
+		if (compaction_running())
+			compaction_abort("JOURNAL was turned off");
+		return;
+	}
+
+	if (compaction_running() || compaction_start())
+		compaction_slice();
+}
+
+// Called from the database write hook. Returns false if the caller has to
+// write the registry to services.db as usual.
+bool journal_save(void)
+{
+	if (!projectsvs.config.journal)
+	{
+		journal_state.valid = false;
+
+		if (retire_countdown && --retire_countdown == 0)
+		{
+			unlink(JOURNAL_BINARY_PATH);
+			unlink(JOURNAL_SNAPSHOT_PATH);
+			unlink(JOURNAL_PATH);
+			unlink(JOURNAL_NEW_PATH);
+			slog(LG_INFO, "freenode/projectns/main: registry is back in services.db, removed the journal files");
+		}
+
+		return false;
+	}
+
+	// the files are in use again
+	retire_countdown = 0;
+
+	// Keep services.db authoritative until we have a usable snapshot
+	if (!journal_state.valid)
+	{
+		schedule_compaction();
+		return false;
+	}
+
+	if (!journal_flush())
+	{
+		journal_state.valid = false;
+		schedule_compaction();
+		return false;
+	}
+
+	if (journal_state.records >= projectsvs.config.journal_compact)
+		schedule_compaction();
+
+	return true;
+}
+
+static bool journal_parse(const char * const path)
+{
+	struct stat sb;
+
+	if (stat(path, &sb) != 0)
+		return false;
+
+	database_handle_t *db = db_open(path, DB_READ);
+	if (!db)
+		return false;
+
+	db_parse(db);
+	db_close(db);
+
+	return true;
+}
+
+static unsigned int journal_peek_seq(const char * const path)
+{
+	unsigned int seq = 0;
+	FILE *f = fopen(path, "r");
+
+	if (f)
+	{
+		if (fscanf(f, DB_TYPE_JOURNAL_SEQ " %u", &seq) != 1)
+			seq = 0;
+		fclose(f);
+	}
+
+	return seq;
+}
+
+static void journal_load(void)
+{
+	/* Project rows in services.db are only written while not journaling,
+	 * so if we already have some, they are newer than any snapshot we might have.
+	 * If we have none, the registry may still be in the snapshot and journal
+	 * written while JOURNAL was on, so load those even if it is off now.
+	 */
+	if (mowgli_patricia_size(projectsvs.projects) != 0)
+	{
+		if (projectsvs.config.journal)
+			schedule_compaction();
+		return;
+	}
+
+	struct timespec start, end;
+	const char *format = "binary";
+	unsigned int seq = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (!snapshot_load(JOURNAL_BINARY_PATH, &seq))
+	{
+		journal_state.loaded_seq = 0;
+		if (!journal_parse(JOURNAL_SNAPSHOT_PATH))
+			return;
+
+		seq = journal_state.loaded_seq;
+		format = "text";
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	slog(LG_INFO, "freenode/projectns/main: loaded %u projects from %s snapshot %u in %.3f ms",
+	     mowgli_patricia_size(projectsvs.projects), format, seq,
+	     (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+	journal_state.seq = seq;
+
+	/* Peek at the journal's sequence number before replaying anything from it.
+	 * If compaction got as far as renaming the snapshots, the journal that goes
+	 * with them may still be waiting next to the old one.
+	 */
+	seq = journal_peek_seq(JOURNAL_PATH);
+	if (seq != journal_state.seq && journal_peek_seq(JOURNAL_NEW_PATH) == journal_state.seq &&
+	    rename(JOURNAL_NEW_PATH, JOURNAL_PATH) == 0)
+		seq = journal_state.seq;
+
+	if (seq == journal_state.seq)
+	{
+		journal_parse(JOURNAL_PATH);
+		clear_dirty();
+		slog(LG_DEBUG, "freenode/projectns/main: loaded snapshot %u and its journal", seq);
+	}
+	else
+		slog(LG_INFO, "freenode/projectns/main: journal does not belong to snapshot %u, ignoring it", journal_state.seq);
+
+	// regular database writes now put the registry back into services.db
+	if (!projectsvs.config.journal)
+	{
+		slog(LG_INFO, "freenode/projectns/main: JOURNAL is off; moving the registry back into services.db");
+		retire_countdown = 2;
+		return;
+	}
+
+	if (seq == journal_state.seq)
+		journal_state.valid = true;
+	else
+		schedule_compaction();
+}
+
+static void journal_startup(void *unused)
+{
+	journal_startup_timer = NULL;
+
+	journal_load();
+
+	// services.db, the snapshot and the journal have all been loaded by now
+	key_indexes_settle();
+}
+
+static void user_rename_hook(hook_user_rename_t *data)
+{
+	mowgli_node_t *n;
+	mowgli_list_t *l = myuser_get_projects(data->mu);
+
+	// contact rows refer to accounts by name
+	MOWGLI_ITER_FOREACH(n, l->head)
+	{
+		struct project_contact *contact = n->data;
+		project_touch(contact->project);
+	}
+}
+
+void init_journal(void)
+{
+	dropped_names = mowgli_patricia_create(strcasecanon);
+	ptrhash_init(&dirty_index);
+
+	hook_add_user_rename(user_rename_hook);
+
+	// Runs once services.db has been loaded; nothing to do if we kept our state across a reload
+	if (!journal_state.valid)
+	{
+		key_indexes_defer();
+		journal_startup_timer = mowgli_timer_add_once(base_eventloop, "projectns_journal_startup", journal_startup, NULL, 0);
+	}
+}
+
+void deinit_journal(void)
+{
+	hook_del_user_rename(user_rename_hook);
+
+	if (journal_startup_timer)
+		mowgli_timer_destroy(base_eventloop, journal_startup_timer);
+	if (journal_compact_timer)
+		mowgli_timer_destroy(base_eventloop, journal_compact_timer);
+	if (compaction_running())
+		compaction_abort("module unloaded");
+
+	// Pointers in the dirty set will not survive a reload, so write them out now
+	if (journal_state.valid && !journal_flush())
+		journal_state.valid = false;
+
+	if (journal_file)
+		fclose(journal_file);
+	journal_file = NULL;
+
+	clear_dirty();
+	mowgli_patricia_destroy(dropped_names, NULL, NULL);
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Ordered key indexes for prefix scans
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Sorted arrays of the keys of projectsvs.projects and the namespace trees,
+ * ordered with the same case folding as the tree they shadow. All keys sharing
+ * a prefix are adjacent, so listing commands can binary search to the start of
+ * a pattern's literal prefix and stop at its end instead of matching every key.
+ * Keys point into the indexed objects and are not copied.
+ *
+ * Insertion and deletion move the tail of the array, which is cheap for the
+ * occasional change. Loading, however, adds namespaces project by project in
+ * no useful order, so between key_indexes_defer() and key_indexes_settle() keys
+ * are simply appended, and the unsorted tail is sorted and merged in once at
+ * the end, or as soon as something needs the index in order.
+ */
+
+#define KEY_INDEX_MIN_SIZE 256U
+
+struct key_index project_keys;
+struct key_index channelns_keys;
+struct key_index cloakns_keys;
+
+/* Kept out of struct key_index, which is handed over on reload: while
+ * deferring, how many entries at the start of each index are in order.
+ */
+static bool deferring;
+static size_t project_keys_sorted, channelns_keys_sorted, cloakns_keys_sorted;
+
+static size_t *sorted_count(const struct key_index * const ki)
+{
+	if (ki == &project_keys)
+		return &project_keys_sorted;
+	if (ki == &channelns_keys)
+		return &channelns_keys_sorted;
+	if (ki == &cloakns_keys)
+		return &cloakns_keys_sorted;
+	return NULL;
+}
+
+void key_index_init(struct key_index * const ki, int (*cmp)(const char *, const char *),
+                    int (*ncmp)(const char *, const char *, size_t))
+{
+	ki->entries = NULL;
+	ki->count   = 0;
+	ki->size    = 0;
+	ki->cmp     = cmp;
+	ki->ncmp    = ncmp;
+}
+
+void key_index_destroy(struct key_index * const ki)
+{
+	free(ki->entries);
+	ki->entries = NULL;
+	ki->count   = 0;
+	ki->size    = 0;
+}
+
+// First position whose key is not less than the given one
+static size_t key_index_lower_bound(const struct key_index * const ki, const char * const key)
+{
+	size_t lo = 0, hi = ki->count;
+
+	while (lo < hi)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (ki->cmp(ki->entries[mid].key, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int (*sort_cmp)(const char *, const char *);
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct key_index_entry *e1 = a, *e2 = b;
+
+	return sort_cmp(e1->key, e2->key);
+}
+
+// Sorts the entries appended while deferring and merges them into the rest
+static void key_index_settle(struct key_index * const ki)
+{
+	size_t * const sorted = sorted_count(ki);
+
+	if (!deferring || !sorted || *sorted >= ki->count)
+		return;
+
+	const size_t n1 = *sorted, n2 = ki->count - n1;
+	struct key_index_entry * const tail = ki->entries + n1;
+
+	sort_cmp = ki->cmp;
+	qsort(tail, n2, sizeof *tail, entry_cmp);
+
+	if (n1 && ki->cmp(ki->entries[n1 - 1].key, tail[0].key) > 0)
+	{
+		// merge from the back so nothing is overwritten before it is read
+		struct key_index_entry *copy = smalloc(n2 * sizeof *copy);
+		memcpy(copy, tail, n2 * sizeof *copy);
+
+		size_t i = n1, j = n2, k = ki->count;
+		while (j)
+		{
+			if (i && ki->cmp(ki->entries[i - 1].key, copy[j - 1].key) > 0)
+				ki->entries[--k] = ki->entries[--i];
+			else
+				ki->entries[--k] = copy[--j];
+		}
+
+		free(copy);
+	}
+
+	*sorted = ki->count;
+}
+
+void key_index_add(struct key_index * const ki, const char * const key, void * const data)
+{
+	if (ki->count == ki->size)
+	{
+		ki->size    = ki->size ? ki->size * 2 : KEY_INDEX_MIN_SIZE;
+		ki->entries = srealloc(ki->entries, ki->size * sizeof *ki->entries);
+	}
+
+	if (deferring && sorted_count(ki))
+	{
+		ki->entries[ki->count].key  = key;
+		ki->entries[ki->count].data = data;
+		ki->count++;
+		return;
+	}
+
+	// appending is the common case while loading, so try that before searching
+	size_t pos = ki->count;
+	if (pos && ki->cmp(ki->entries[pos - 1].key, key) > 0)
+		pos = key_index_lower_bound(ki, key);
+
+	memmove(&ki->entries[pos + 1], &ki->entries[pos], (ki->count - pos) * sizeof *ki->entries);
+	ki->entries[pos].key  = key;
+	ki->entries[pos].data = data;
+	ki->count++;
+}
+
+bool key_index_delete(struct key_index * const ki, const char * const key)
+{
+	key_index_settle(ki);
+
+	const size_t pos = key_index_lower_bound(ki, key);
+
+	if (pos == ki->count || ki->cmp(ki->entries[pos].key, key) != 0)
+		return false;
+
+	memmove(&ki->entries[pos], &ki->entries[pos + 1], (ki->count - pos - 1) * sizeof *ki->entries);
+	ki->count--;
+
+	size_t * const sorted = sorted_count(ki);
+	if (deferring && sorted)
+		*sorted = ki->count;
+
+	return true;
+}
+
+// First position whose key is greater than the given one
+static size_t key_index_upper_bound(const struct key_index * const ki, const char * const key)
+{
+	size_t lo = 0, hi = ki->count;
+
+	while (lo < hi)
+	{
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (ki->cmp(ki->entries[mid].key, key) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Calls cb for every key starting with prefix, in order, until it returns
+ * nonzero. If after is given, keys up to and including it are skipped, which
+ * lets a listing resume where an earlier one stopped even if the index has
+ * changed since. cb must not change the index. Returns the number of keys visited.
+ */
+unsigned int key_index_foreach_prefix(struct key_index * const ki, const char * const prefix, const char * const after,
+                                      int (*cb)(const char *key, void *data, void *privdata), void *privdata)
+{
+	const size_t len = strlen(prefix);
+	unsigned int visited = 0;
+	size_t i;
+
+	key_index_settle(ki);
+
+	if (after && ki->cmp(after, prefix) >= 0)
+		i = key_index_upper_bound(ki, after);
+	else
+		i = key_index_lower_bound(ki, prefix);
+
+	for (; i < ki->count; i++)
+	{
+		if (ki->ncmp(ki->entries[i].key, prefix, len) != 0)
+			break;
+
+		visited++;
+		if (cb(ki->entries[i].key, ki->entries[i].data, privdata))
+			break;
+	}
+
+	return visited;
+}
+
+unsigned int projects_foreach_prefix(const char * const prefix, const char * const after,
+                                     int (*cb)(const char *key, void *data, void *privdata), void *privdata)
+{
+	return key_index_foreach_prefix(&project_keys, prefix, after, cb, privdata);
+}
+
+unsigned int channelns_foreach_prefix(const char * const prefix, const char * const after,
+                                      int (*cb)(const char *key, void *data, void *privdata), void *privdata)
+{
+	return key_index_foreach_prefix(&channelns_keys, prefix, after, cb, privdata);
+}
+
+unsigned int cloakns_foreach_prefix(const char * const prefix, const char * const after,
+                                    int (*cb)(const char *key, void *data, void *privdata), void *privdata)
+{
+	return key_index_foreach_prefix(&cloakns_keys, prefix, after, cb, privdata);
+}
+
+// Same folding as the trees: strcasecanon for projects and cloaks, irccasecanon for channels
+void init_key_indexes(void)
+{
+	key_index_init(&project_keys, strcasecmp, strncasecmp);
+	key_index_init(&channelns_keys, irccasecmp, ircncasecmp);
+	key_index_init(&cloakns_keys, strcasecmp, strncasecmp);
+	deferring = false;
+}
+
+// Until key_indexes_settle(), added keys are only put in order when needed
+void key_indexes_defer(void)
+{
+	if (deferring)
+		return;
+
+	project_keys_sorted   = project_keys.count;
+	channelns_keys_sorted = channelns_keys.count;
+	cloakns_keys_sorted   = cloakns_keys.count;
+	deferring = true;
+}
+
+void key_indexes_settle(void)
+{
+	key_index_settle(&project_keys);
+	key_index_settle(&channelns_keys);
+	key_index_settle(&cloakns_keys);
+	deferring = false;
+}
+
+void deinit_key_indexes(void)
+{
+	key_index_destroy(&project_keys);
+	key_index_destroy(&channelns_keys);
+	key_index_destroy(&cloakns_keys);
+	deferring = false;
+}
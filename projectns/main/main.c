@@ -16,12 +16,42 @@ struct projectsvs projectsvs = {
 	.project_new = project_new,
 	.project_find = project_find,
 	.project_destroy = project_destroy,
+	.project_touch = project_touch,
+	.project_rename = project_rename,
+	.project_render = project_render,
+	.project_set_creation = project_set_creation,
+	.projects_by_creation = projects_by_creation,
 	.contact_new = contact_new,
 	.contact_destroy = contact_destroy,
+	.contact_find = contact_find,
+	.is_contact = is_contact,
+	.channelns_find = channelns_find,
+	.cloakns_find = cloakns_find,
+	.channelns_add = channelns_add,
+	.channelns_del = channelns_del,
+	.cloakns_add = cloakns_add,
+	.cloakns_del = cloakns_del,
+	.mark_new = mark_new,
+	.mark_destroy = mark_destroy,
+	.mark_find = mark_find,
 	.show_marks = show_marks,
 	.is_valid_project_name = is_valid_project_name,
 	.myuser_get_projects = myuser_get_projects,
 	.channame_get_project = channame_get_project,
+	.show_pool_stats = show_pool_stats,
+	.show_registry_stats = show_registry_stats,
+	.cloakns_foreach_online = cloakns_foreach_online,
+	.projects_foreach_prefix = projects_foreach_prefix,
+	.channelns_foreach_prefix = channelns_foreach_prefix,
+	.cloakns_foreach_prefix = cloakns_foreach_prefix,
+	.glob_literal_prefix = glob_literal_prefix,
+	.glob_compile = glob_compile,
+	.glob_match = glob_match,
+	.glob_free = glob_free,
+	.parse_page_options = parse_page_options,
+	.export_start = export_start,
+	.export_running = export_running,
+	.is_valid_data_file_name = is_valid_data_file_name,
 };
 
 static void mod_init(module_t *const restrict m)
@@ -36,10 +66,15 @@ static void mod_init(module_t *const restrict m)
 
 	init_config();
 	init_db();
+	init_journal();
+	init_online();
 }
 
 static void mod_deinit(const module_unload_intent_t intent)
 {
+	deinit_export();
+	deinit_online();
+	deinit_journal();
 	persist_save_data();
 
 	deinit_aux_structures();
@@ -12,37 +12,251 @@
 #include "fn-compat.h"
 #include "../projectns_common.h"
 
+// where accounts' contact lists were kept before PROJECTNS_MINVER_ACCOUNT_INDEX
 #define MYUSER_PRIVDATA_NAME "freenode:projects"
 
+struct ptrhash_entry {
+	const void *k1, *k2;
+	void *value;
+};
+
+struct ptrhash {
+	struct ptrhash_entry *table;
+	size_t size;
+	size_t count;
+};
+
+struct slab {
+	mowgli_heap_t *heap;
+	size_t elem_size;
+	unsigned int live;
+	unsigned int peak;
+};
+
+struct string_arena {
+	mowgli_list_t blocks;
+	struct arena_block *current;
+	size_t reserved;    // bytes in all blocks
+	size_t live_bytes;  // bytes held by allocations not yet freed
+	unsigned int live;
+};
+
+struct object_pools {
+	struct slab projects;
+	struct slab contacts;
+	struct slab marks;
+	struct string_arena namespaces;
+};
+
+struct key_index_entry {
+	const char *key;
+	void *data;
+};
+
+struct key_index {
+	struct key_index_entry *entries;  // sorted by cmp
+	size_t count;
+	size_t size;
+	int (*cmp)(const char *, const char *);
+	int (*ncmp)(const char *, const char *, size_t);
+};
+
+// the record owning a node in a project's channel_ns or cloak_ns list
+static inline struct project_namespace *namespace_of(mowgli_node_t * const n)
+{
+	return (struct project_namespace *)((char *)n - offsetof(struct project_namespace, node));
+}
+
+// alloc.c
+extern struct object_pools object_pools;
+void *slab_alloc(struct slab * const s);
+void slab_free(struct slab * const s, void * const ptr);
+void *arena_alloc(struct string_arena * const a, const size_t size);
+void arena_free(struct string_arena * const a, void * const ptr, const size_t size);
+void init_object_pools(void);
+void destroy_object_pools(struct object_pools * const pools);
+void show_pool_stats(sourceinfo_t *si);
+
+// keyindex.c
+extern struct key_index project_keys;
+extern struct key_index channelns_keys;
+extern struct key_index cloakns_keys;
+void key_index_init(struct key_index * const ki, int (*cmp)(const char *, const char *),
+                    int (*ncmp)(const char *, const char *, size_t));
+void key_index_destroy(struct key_index * const ki);
+void key_indexes_defer(void);
+void key_indexes_settle(void);
+void key_index_add(struct key_index * const ki, const char * const key, void * const data);
+bool key_index_delete(struct key_index * const ki, const char * const key);
+unsigned int key_index_foreach_prefix(struct key_index * const ki, const char * const prefix, const char * const after,
+                                      int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+unsigned int projects_foreach_prefix(const char * const prefix, const char * const after,
+                                     int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+unsigned int channelns_foreach_prefix(const char * const prefix, const char * const after,
+                                      int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+unsigned int cloakns_foreach_prefix(const char * const prefix, const char * const after,
+                                    int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+void init_key_indexes(void);
+void deinit_key_indexes(void);
+
 // main.c
 extern unsigned int projectns_abirev;
 extern struct projectsvs projectsvs;
 
 // config.c
+extern bool namespace_separator_map[UCHAR_MAX + 1];
 void init_config(void);
 void deinit_config(void);
 
+// creation.c
+void project_set_creation(struct projectns * const p, const time_t time, const char * const creator);
+void creation_index_forget(struct projectns * const p);
+void creation_index_restore(struct projectns * const p);
+void creation_index_reset(void);
+unsigned int projects_by_creation(const time_t after, const time_t before, const char * const creator,
+                                  const time_t from_time, const char * const from_name,
+                                  int (*cb)(struct projectns *p, void *privdata), void *privdata);
+size_t creation_index_bytes(void);
+
 // db.c
+#define DB_TYPE_PROJECT           "FNGROUP"
+#define DB_TYPE_REGINFO           "FNGRI"
+#define DB_TYPE_CONTACT           "FNGC"
+#define DB_TYPE_CHANNEL_NAMESPACE "FNCNS"
+#define DB_TYPE_CLOAK_NAMESPACE   "FNHNS"
+#define DB_TYPE_MARK              "FNGM"
+#define DB_TYPE_PROJECT_DROP      "FNGDROP"
+#define DB_TYPE_JOURNAL_SEQ       "FNJSEQ"
+
+struct row_writer {
+	void (*start_row)(void *h, const char *type);
+	void (*write_word)(void *h, const char *word);
+	void (*write_str)(void *h, const char *str);
+	void (*write_uint)(void *h, unsigned int num);
+	void (*write_time)(void *h, time_t time);
+	void (*commit_row)(void *h);
+};
+
+// the most recent write_projects_db()
+struct db_write_stats {
+	time_t time;          // 0 if there has been none yet
+	double duration_ms;
+	unsigned int rows;
+	bool journal;         // rows went to the journal instead of services.db
+};
+
+extern const struct row_writer db_row_writer;
+extern struct db_write_stats db_write_stats;
+unsigned int write_project_rows(const struct row_writer * const w, void * const h, struct projectns * const project);
 void init_db(void);
 void deinit_db(void);
 
+// export.c
+bool export_start(const char * const filename, const char * const requester);
+bool export_running(void);
+void deinit_export(void);
+
+// glob.c
+struct compiled_glob *glob_compile(const char * const pattern);
+bool glob_match(const struct compiled_glob * const g, const char * const name);
+void glob_free(struct compiled_glob * const g);
+
+// hash.c
+void ptrhash_init(struct ptrhash *h);
+void ptrhash_destroy(struct ptrhash *h);
+void *ptrhash_get(const struct ptrhash *h, const void *k1, const void *k2);
+void ptrhash_put(struct ptrhash *h, const void *k1, const void *k2, void *value);
+void *ptrhash_delete(struct ptrhash *h, const void *k1, const void *k2);
+size_t ptrhash_bytes(const struct ptrhash *h);
+
+// journal.c
+struct journal_state {
+	bool valid;               // snapshot + journal hold everything except the dirty set
+	unsigned int seq;         // ties a journal file to the snapshot it extends
+	unsigned int loaded_seq;  // last FNJSEQ row seen while parsing
+	unsigned int records;     // rows appended since the last compaction
+};
+
+extern struct journal_state journal_state;
+extern const struct row_writer file_row_writer;
+void journal_touch(struct projectns * const p);
+void project_rename(struct projectns * const p, const char * const newname);
+void journal_forget(struct projectns * const p);
+bool journal_save(void);
+void init_journal(void);
+void deinit_journal(void);
+
 // objects.c
 struct project_contact *contact_new(struct projectns * const p, myuser_t * const mu);
 bool contact_destroy(struct projectns * const p, myuser_t * const mt);
+struct project_contact *contact_find(const struct projectns * const p, const myuser_t * const mu);
+bool is_contact(const struct projectns * const p, const myuser_t * const mu);
+void contact_index_add(struct project_contact * const contact);
+void contact_index_save(struct ptrhash * const out);
+void contact_index_restore(const struct ptrhash * const in);
+size_t contact_index_count(void);
+void object_index_bytes(size_t * const contacts, size_t * const marks, size_t * const accounts);
+mowgli_list_t *myuser_get_projects(myuser_t * const mu);
+void account_index_add(struct project_contact * const contact);
+void account_index_save(struct ptrhash * const out);
+void account_index_restore(const struct ptrhash * const in);
+void account_index_destroy(struct ptrhash * const h);
+size_t account_index_count(void);
+struct project_namespace *channelns_find(const char * const ns);
+struct project_namespace *cloakns_find(const char * const ns);
+bool channelns_add(struct projectns * const p, const char * const ns);
+bool channelns_del(struct projectns * const p, const char * const ns);
+bool cloakns_add(struct projectns * const p, const char * const ns);
+bool cloakns_del(struct projectns * const p, const char * const ns);
+struct project_mark *mark_new(struct projectns * const p, const unsigned int number, const time_t time,
+                              const char * const setter_id, const char * const setter_name, const char * const text);
+void mark_destroy(struct projectns * const p, struct project_mark * const mark);
+struct project_mark *mark_find(const struct projectns * const p, const unsigned int number);
+myuser_t *mark_setter(struct project_mark * const mark);
+extern unsigned int mark_setter_epoch;
+void mark_index_add(const struct projectns * const p, struct project_mark * const mark);
+void mark_index_save(struct ptrhash * const out);
+void mark_index_restore(const struct ptrhash * const in);
+size_t mark_index_count(void);
+void audit_update(struct projectns * const p);
+void project_touch(struct projectns * const p);
 struct projectns *project_new(const char * const name);
 struct projectns *project_find(const char * const name);
 void project_destroy(struct projectns * const p);
 void init_structures(void);
 void deinit_aux_structures(void);
 
+// online.c
+unsigned int cloakns_foreach_online(const struct project_namespace * const ns, void (*cb)(user_t *u, void *privdata), void *privdata);
+void init_online(void);
+void deinit_online(void);
+
 // persist.c
 void persist_save_data(void);
 bool persist_load_data(module_t *m);
 
+// render.c
+const struct project_render *project_render(struct projectns * const p, const enum project_render_view view);
+void render_forget(struct projectns * const p);
+
+// stats.c
+void show_registry_stats(sourceinfo_t *si);
+
+// snapshot.c
+struct snapshot_writer;
+struct snapshot_writer *snapshot_begin(const char * const path, const unsigned int seq);
+void snapshot_add_project(struct snapshot_writer * const sw, const struct projectns * const p);
+bool snapshot_finish(struct snapshot_writer * const sw);
+void snapshot_abort(struct snapshot_writer * const sw);
+bool snapshot_write(const char * const path, const unsigned int seq);
+bool snapshot_load(const char * const path, unsigned int * const seq);
+
 // util.c
 bool is_valid_project_name(const char * const name);
-struct projectns *channame_get_project(const char * const name, char **out_namespace);
-mowgli_list_t *myuser_get_projects(myuser_t *mu);
-void show_marks(sourceinfo_t *si, struct projectns *p);
+bool is_valid_data_file_name(const char * const name, const char * const suffix);
+struct projectns *channame_get_project(const char * const name, char *out_namespace, size_t namespace_len);
+unsigned int show_marks(sourceinfo_t *si, struct projectns *p, unsigned int offset, unsigned int count);
+void glob_literal_prefix(const char * const pattern, char * const buf, const size_t bufsize);
+bool parse_page_options(const int parc, char *parv[], struct page_options * const opts);
 
 #endif
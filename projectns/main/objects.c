@@ -9,54 +9,288 @@
 #include "fn-compat.h"
 #include "main.h"
 
-struct project_contact *contact_new(struct projectns * const p, myuser_t * const mu)
+// (project, myuser) -> struct project_contact
+static struct ptrhash contact_index;
+
+// (project, mark number) -> struct project_mark
+static struct ptrhash mark_index;
+
+/* (myuser, NULL) -> list of that account's struct project_contact, linked
+ * through myuser_n. Only accounts that are contacts somewhere have an entry, so
+ * looking up any other account is a single probe that allocates nothing.
+ */
+static struct ptrhash account_index;
+static mowgli_list_t no_projects;
+
+/* A mark's cached setter lookup is valid while its epoch matches this one.
+ * Dropping an account bumps it; renames need nothing as the name is read
+ * through the cached account. Starts at 1 so fresh marks are never valid.
+ */
+unsigned int mark_setter_epoch = 1;
+
+void contact_index_add(struct project_contact * const contact)
 {
-	mowgli_node_t *n, *tn;
-	MOWGLI_ITER_FOREACH(n, p->contacts.head)
+	ptrhash_put(&contact_index, contact->project, contact->mu, contact);
+}
+
+// The returned list must not be changed; accounts without projects all share one empty list
+mowgli_list_t *myuser_get_projects(myuser_t * const mu)
+{
+	mowgli_list_t *l = ptrhash_get(&account_index, mu, NULL);
+
+	return l ? l : &no_projects;
+}
+
+void account_index_add(struct project_contact * const contact)
+{
+	mowgli_list_t *l = ptrhash_get(&account_index, contact->mu, NULL);
+
+	if (!l)
 	{
-		struct project_contact *other = n->data;
+		l = mowgli_list_create();
+		ptrhash_put(&account_index, contact->mu, NULL, l);
+	}
+
+	mowgli_node_add(contact, &contact->myuser_n, l);
+}
 
-		if (other->mu == mu)
-			return NULL;
+static void account_index_delete(struct project_contact * const contact)
+{
+	mowgli_list_t *l = ptrhash_get(&account_index, contact->mu, NULL);
+
+	if (!l)
+		return;
+
+	mowgli_node_delete(&contact->myuser_n, l);
+	if (!l->count)
+	{
+		ptrhash_delete(&account_index, contact->mu, NULL);
+		mowgli_list_free(l);
 	}
+}
 
-	struct project_contact *contact = smalloc(sizeof *contact);
+struct project_contact *contact_find(const struct projectns * const p, const myuser_t * const mu)
+{
+	return ptrhash_get(&contact_index, p, mu);
+}
+
+bool is_contact(const struct projectns * const p, const myuser_t * const mu)
+{
+	return contact_find(p, mu) != NULL;
+}
+
+struct project_contact *contact_new(struct projectns * const p, myuser_t * const mu)
+{
+	if (contact_find(p, mu))
+		return NULL;
+
+	struct project_contact *contact = slab_alloc(&object_pools.contacts);
 	contact->project = p;
 	contact->mu      = mu;
 
-	mowgli_node_add(contact, &contact->myuser_n,  projectsvs.myuser_get_projects(mu));
+	account_index_add(contact);
 	mowgli_node_add(contact, &contact->project_n, &p->contacts);
+	contact_index_add(contact);
+	project_touch(p);
 	return contact;
 }
 
 bool contact_destroy(struct projectns * const p, myuser_t * const mu)
 {
-	mowgli_list_t *mu_projects = projectsvs.myuser_get_projects(mu);
-	mowgli_node_t *n, *tn;
+	struct project_contact *contact = ptrhash_delete(&contact_index, p, mu);
+
+	if (!contact)
+		return false;
+
+	account_index_delete(contact);
+	mowgli_node_delete(&contact->project_n, &p->contacts);
+	slab_free(&object_pools.contacts, contact);
+	project_touch(p);
+	return true;
+}
+
+// Namespace records are packed into the arena together with their name
+static struct project_namespace *namespace_new(struct projectns * const p, mowgli_list_t * const list,
+                                               mowgli_patricia_t * const tree, struct key_index * const keys,
+                                               const char * const name)
+{
+	const size_t len = strlen(name) + 1;
+	struct project_namespace *ns = arena_alloc(&object_pools.namespaces, sizeof *ns + len);
+
+	ns->project = p;
+	memcpy(ns->name, name, len);
+
+	mowgli_node_add(ns->name, &ns->node, list);
+	mowgli_patricia_add(tree, name, ns);
+	key_index_add(keys, ns->name, ns);
+
+	return ns;
+}
+
+static void namespace_destroy(struct project_namespace * const ns, mowgli_list_t * const list, mowgli_patricia_t * const tree,
+                              struct key_index * const keys)
+{
+	key_index_delete(keys, ns->name);
+	mowgli_patricia_delete(tree, ns->name);
+	mowgli_node_delete(&ns->node, list);
+	arena_free(&object_pools.namespaces, ns, sizeof *ns + strlen(ns->name) + 1);
+}
+
+struct project_namespace *channelns_find(const char * const ns)
+{
+	return mowgli_patricia_retrieve(projectsvs.channel_namespaces, ns);
+}
+
+struct project_namespace *cloakns_find(const char * const ns)
+{
+	return mowgli_patricia_retrieve(projectsvs.cloak_namespaces, ns);
+}
+
+bool channelns_add(struct projectns * const p, const char * const ns)
+{
+	if (channelns_find(ns))
+		return false;
+
+	namespace_new(p, &p->channel_ns, projectsvs.channel_namespaces, &channelns_keys, ns);
+	project_touch(p);
+	return true;
+}
+
+bool channelns_del(struct projectns * const p, const char * const ns)
+{
+	struct project_namespace *rec = channelns_find(ns);
+
+	if (!rec || rec->project != p)
+		return false;
+
+	namespace_destroy(rec, &p->channel_ns, projectsvs.channel_namespaces, &channelns_keys);
+	project_touch(p);
+	return true;
+}
+
+bool cloakns_add(struct projectns * const p, const char * const ns)
+{
+	if (cloakns_find(ns))
+		return false;
+
+	namespace_new(p, &p->cloak_ns, projectsvs.cloak_namespaces, &cloakns_keys, ns);
+	project_touch(p);
+	return true;
+}
+
+bool cloakns_del(struct projectns * const p, const char * const ns)
+{
+	struct project_namespace *rec = cloakns_find(ns);
+
+	if (!rec || rec->project != p)
+		return false;
+
+	namespace_destroy(rec, &p->cloak_ns, projectsvs.cloak_namespaces, &cloakns_keys);
+	project_touch(p);
+	return true;
+}
+
+static inline const void *mark_key(const unsigned int number)
+{
+	return (const void *)(uintptr_t)number;
+}
+
+void mark_index_add(const struct projectns * const p, struct project_mark * const mark)
+{
+	ptrhash_put(&mark_index, p, mark_key(mark->number), mark);
+}
+
+struct project_mark *mark_find(const struct projectns * const p, const unsigned int number)
+{
+	return ptrhash_get(&mark_index, p, mark_key(number));
+}
+
+// A number of 0 assigns the project's next mark ID; returns NULL if the given one is taken
+struct project_mark *mark_new(struct projectns * const p, const unsigned int number, const time_t time,
+                              const char * const setter_id, const char * const setter_name, const char * const text)
+{
+	if (number && mark_find(p, number))
+		return NULL;
+
+	struct project_mark *mark = slab_alloc(&object_pools.marks);
+
+	mark->number      = number ? number : p->last_mark_id + 1;
+	mark->time        = time;
+	mark->mark        = sstrdup(text);
+	mark->setter_id   = sstrdup(setter_id);
+	mark->setter_name = sstrdup(setter_name);
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu_projects->head)
+	if (mark->number > p->last_mark_id)
+		p->last_mark_id = mark->number;
+
+	mowgli_node_add(mark, &mark->node, &p->marks);
+	mark_index_add(p, mark);
+	project_touch(p);
+	return mark;
+}
+
+void mark_destroy(struct projectns * const p, struct project_mark * const mark)
+{
+	ptrhash_delete(&mark_index, p, mark_key(mark->number));
+	mowgli_node_delete(&mark->node, &p->marks);
+
+	free(mark->setter_id);
+	free(mark->setter_name);
+	free(mark->mark);
+	slab_free(&object_pools.marks, mark);
+
+	project_touch(p);
+}
+
+// The account that set a mark, or NULL if it has since been dropped
+myuser_t *mark_setter(struct project_mark * const mark)
+{
+	if (mark->setter_epoch != mark_setter_epoch)
 	{
-		struct project_contact *contact = n->data;
-		if (p == contact->project)
-		{
-			mowgli_node_delete(&contact->myuser_n,  mu_projects);
-			mowgli_node_delete(&contact->project_n, &p->contacts);
-			free(contact);
-			return true;
-		}
+		mark->setter       = myuser_find_uid(mark->setter_id);
+		mark->setter_epoch = mark_setter_epoch;
 	}
 
-	return false;
+	return mark->setter;
+}
+
+static void audit_set(struct projectns * const p, const enum project_audit_set set, const bool member)
+{
+	if (member == !!(p->audit_sets & (1U << set)))
+		return;
+
+	if (member)
+		mowgli_node_add(p, &p->audit_n[set], &projectsvs.audit_sets[set]);
+	else
+		mowgli_node_delete(&p->audit_n[set], &projectsvs.audit_sets[set]);
+
+	p->audit_sets ^= 1U << set;
+}
+
+// Files the project under the AUDIT sets it currently belongs to
+void audit_update(struct projectns * const p)
+{
+	audit_set(p, PROJECT_AUDIT_NO_CHANNELS, !p->channel_ns.count);
+	audit_set(p, PROJECT_AUDIT_NO_CONTACTS, !p->contacts.count);
+}
+
+void project_touch(struct projectns * const p)
+{
+	p->generation++;
+	audit_update(p);
+	journal_touch(p);
 }
 
 struct projectns *project_new(const char * const name)
 {
-	struct projectns *project = smalloc(sizeof *project);
+	struct projectns *project = slab_alloc(&object_pools.projects);
 
 	project->name = sstrdup(name);
 	project->any_may_register = projectsvs.config.default_open_registration;
 
 	mowgli_patricia_add(projectsvs.projects, name, project);
+	key_index_add(&project_keys, project->name, project);
+	project_touch(project);
 
 	return project;
 }
@@ -68,6 +302,7 @@ struct projectns *project_find(const char * const name)
 
 void project_destroy(struct projectns * const p)
 {
+	key_index_delete(&project_keys, p->name);
 	mowgli_patricia_delete(projectsvs.projects, p->name);
 
 	mowgli_node_t *n, *tn;
@@ -80,74 +315,162 @@ void project_destroy(struct projectns * const p)
 
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, p->channel_ns.head)
 	{
-		char *ns = n->data;
-		mowgli_patricia_delete(projectsvs.projects_by_channelns, ns);
-
-		free(ns);
-
-		mowgli_node_delete(n, &p->channel_ns);
-		mowgli_node_free(n);
+		namespace_destroy(namespace_of(n), &p->channel_ns, projectsvs.channel_namespaces, &channelns_keys);
 	}
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, p->cloak_ns.head)
 	{
-		char *ns = n->data;
-		mowgli_patricia_delete(projectsvs.projects_by_cloakns, ns);
-
-		free(ns);
-
-		mowgli_node_delete(n, &p->cloak_ns);
-		mowgli_node_free(n);
+		namespace_destroy(namespace_of(n), &p->cloak_ns, projectsvs.cloak_namespaces, &cloakns_keys);
 	}
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, p->marks.head)
 	{
-		struct project_mark *mark = n->data;
+		mark_destroy(p, n->data);
+	}
 
-		free(mark->setter_id);
-		free(mark->setter_name);
-		free(mark->mark);
-		free(mark);
+	creation_index_forget(p);
+
+	// last, as removing everything above touches the project again
+	journal_forget(p);
+	render_forget(p);
+	for (unsigned int i = 0; i < PROJECT_AUDIT_SETS; i++)
+		audit_set(p, i, false);
 
-		mowgli_node_delete(n, &p->marks);
-		mowgli_node_free(n);
-	}
 	free(p->name);
 	free(p->reginfo);
 	strshare_unref(p->creator);
-	free(p);
+	slab_free(&object_pools.projects, p);
 }
 
 static void userdelete_hook(myuser_t *mu)
 {
-	mowgli_list_t *l = myuser_get_projects(mu);
 	mowgli_node_t *n, *tn;
 
+	if (!++mark_setter_epoch)
+		mark_setter_epoch = 1;
+
+	mowgli_list_t *l = ptrhash_delete(&account_index, mu, NULL);
+	if (!l)
+		return;
+
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
 	{
 		struct project_contact *contact = n->data;
 		mowgli_node_delete(n, l);
 		mowgli_node_delete(&contact->project_n, &contact->project->contacts);
+		ptrhash_delete(&contact_index, contact->project, mu);
+		project_touch(contact->project);
 
 		slog(LG_REGISTER, _("PROJECT:CONTACT:LOST: \2%s\2 from \2%s\2"), entity(mu)->name, contact->project->name);
 
-		free(contact);
+		slab_free(&object_pools.contacts, contact);
 	}
 
 	mowgli_list_free(l);
 }
 
+// Hands the contact index over to the next copy of this module on reload
+void contact_index_save(struct ptrhash * const out)
+{
+	*out = contact_index;
+	ptrhash_init(&contact_index);
+}
+
+void contact_index_restore(const struct ptrhash * const in)
+{
+	ptrhash_destroy(&contact_index);
+	contact_index = *in;
+}
+
+size_t contact_index_count(void)
+{
+	return contact_index.count;
+}
+
+void object_index_bytes(size_t * const contacts, size_t * const marks, size_t * const accounts)
+{
+	*contacts = ptrhash_bytes(&contact_index);
+	*marks    = ptrhash_bytes(&mark_index);
+	*accounts = ptrhash_bytes(&account_index) + account_index.count * sizeof(mowgli_list_t);
+}
+
+void account_index_save(struct ptrhash * const out)
+{
+	*out = account_index;
+	ptrhash_init(&account_index);
+}
+
+void account_index_restore(const struct ptrhash * const in)
+{
+	account_index_destroy(&account_index);
+	account_index = *in;
+}
+
+// Frees the per-account lists of a table; the contacts linked into them are left alone
+void account_index_destroy(struct ptrhash * const h)
+{
+	for (size_t i = 0; i < h->size; i++)
+		if (h->table[i].k1)
+			mowgli_list_free(h->table[i].value);
+
+	ptrhash_destroy(h);
+}
+
+// Number of contacts over all accounts' lists
+size_t account_index_count(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < account_index.size; i++)
+		if (account_index.table[i].k1)
+			count += ((mowgli_list_t *)account_index.table[i].value)->count;
+
+	return count;
+}
+
+void mark_index_save(struct ptrhash * const out)
+{
+	*out = mark_index;
+	ptrhash_init(&mark_index);
+}
+
+void mark_index_restore(const struct ptrhash * const in)
+{
+	ptrhash_destroy(&mark_index);
+	mark_index = *in;
+}
+
+size_t mark_index_count(void)
+{
+	return mark_index.count;
+}
+
 void init_structures(void)
 {
+	init_object_pools();
+	init_key_indexes();
+
 	projectsvs.projects = mowgli_patricia_create(strcasecanon);
-	projectsvs.projects_by_channelns = mowgli_patricia_create(irccasecanon);
-	projectsvs.projects_by_cloakns = mowgli_patricia_create(strcasecanon);
+	projectsvs.channel_namespaces = mowgli_patricia_create(irccasecanon);
+	projectsvs.cloak_namespaces = mowgli_patricia_create(strcasecanon);
+	ptrhash_init(&contact_index);
+	ptrhash_init(&mark_index);
+	ptrhash_init(&account_index);
 
 	hook_add_myuser_delete(userdelete_hook);
 }
 
 void deinit_aux_structures(void)
 {
-	mowgli_patricia_destroy(projectsvs.projects_by_channelns, NULL, NULL);
-	mowgli_patricia_destroy(projectsvs.projects_by_cloakns, NULL, NULL);
+	// these are gone already if they were handed over for reload
+	if (projectsvs.channel_namespaces)
+		mowgli_patricia_destroy(projectsvs.channel_namespaces, NULL, NULL);
+	if (projectsvs.cloak_namespaces)
+		mowgli_patricia_destroy(projectsvs.cloak_namespaces, NULL, NULL);
+	ptrhash_destroy(&contact_index);
+	ptrhash_destroy(&mark_index);
+	account_index_destroy(&account_index);
+	deinit_key_indexes();
+	creation_index_reset();
+	destroy_object_pools(&object_pools);
 
 	hook_del_myuser_delete(userdelete_hook);
 }
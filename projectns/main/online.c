@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Index of online users by cloak namespace
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Every online user whose vhost looks like a cloak is filed under each
+ * "/"-separated prefix of it, so "about/sometopic/nick" is found under both
+ * "about" and "about/sometopic". Indexing by prefix rather than by registered
+ * namespace means CLOAK ADD/DEL never have to move users around; queries drop
+ * users that belong to a longer registered namespace instead.
+ */
+
+struct online_bucket {
+	mowgli_list_t users;
+	char prefix[];
+};
+
+struct online_link {
+	mowgli_node_t node;
+	struct online_bucket *bucket;
+};
+
+struct online_user {
+	user_t *u;
+	size_t nlinks;
+	struct online_link links[];  // shortest prefix first
+};
+
+static mowgli_patricia_t *online_index;
+
+// user_t -> struct online_user
+static struct ptrhash online_users;
+
+static void online_user_remove(user_t *u)
+{
+	struct online_user *ou = ptrhash_delete(&online_users, u, NULL);
+
+	if (!ou)
+		return;
+
+	for (size_t i = 0; i < ou->nlinks; i++)
+	{
+		struct online_bucket *b = ou->links[i].bucket;
+
+		mowgli_node_delete(&ou->links[i].node, &b->users);
+		if (!b->users.count)
+		{
+			mowgli_patricia_delete(online_index, b->prefix);
+			free(b);
+		}
+	}
+
+	free(ou);
+}
+
+static void online_user_add(user_t *u)
+{
+	const char *host = u->vhost;
+	size_t nlinks = 0;
+
+	if (!host || !strchr(host, '/'))
+		return;
+
+	for (const char *c = host + 1; *c; c++)
+		if (*c == '/')
+			nlinks++;
+
+	struct online_user *ou = smalloc(sizeof *ou + nlinks * sizeof ou->links[0]);
+	ou->u      = u;
+	ou->nlinks = nlinks;
+
+	char prefix[HOSTLEN + 1];
+	size_t i = 0;
+
+	for (size_t len = 1; host[len] && i < nlinks; len++)
+	{
+		if (host[len] != '/')
+			continue;
+
+		mowgli_strlcpy(prefix, host, len < sizeof prefix ? len + 1 : sizeof prefix);
+
+		struct online_bucket *b = mowgli_patricia_retrieve(online_index, prefix);
+		if (!b)
+		{
+			const size_t plen = strlen(prefix) + 1;
+			b = smalloc(sizeof *b + plen);
+			memset(&b->users, 0, sizeof b->users);
+			memcpy(b->prefix, prefix, plen);
+			mowgli_patricia_add(online_index, b->prefix, b);
+		}
+
+		ou->links[i].bucket = b;
+		mowgli_node_add(u, &ou->links[i].node, &b->users);
+		i++;
+	}
+
+	ptrhash_put(&online_users, u, NULL, ou);
+}
+
+// The registered cloak namespace a user's vhost falls under, if any
+static struct project_namespace *online_user_cloakns(const struct online_user *ou)
+{
+	for (size_t i = ou->nlinks; i > 0; i--)
+	{
+		struct project_namespace *ns = cloakns_find(ou->links[i - 1].bucket->prefix);
+		if (ns)
+			return ns;
+	}
+
+	return NULL;
+}
+
+unsigned int cloakns_foreach_online(const struct project_namespace * const ns, void (*cb)(user_t *u, void *privdata), void *privdata)
+{
+	struct online_bucket *b = mowgli_patricia_retrieve(online_index, ns->name);
+	unsigned int count = 0;
+	mowgli_node_t *n;
+
+	if (!b)
+		return 0;
+
+	MOWGLI_ITER_FOREACH(n, b->users.head)
+	{
+		user_t *u = n->data;
+
+		if (online_user_cloakns(ptrhash_get(&online_users, u, NULL)) != ns)
+			continue;
+
+		count++;
+		if (cb)
+			cb(u, privdata);
+	}
+
+	return count;
+}
+
+static void user_add_hook(hook_user_nick_t *data)
+{
+	// may have been killed by an earlier hook
+	if (data->u)
+		online_user_add(data->u);
+}
+
+static void user_delete_hook(user_t *u)
+{
+	online_user_remove(u);
+}
+
+static void user_sethost_hook(user_t *u)
+{
+	online_user_remove(u);
+	online_user_add(u);
+}
+
+void init_online(void)
+{
+	online_index = mowgli_patricia_create(strcasecanon);
+	ptrhash_init(&online_users);
+
+	// users that connected before we were loaded
+	mowgli_patricia_iteration_state_t state;
+	user_t *u;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		online_user_add(u);
+	}
+
+	hook_add_user_add(user_add_hook);
+	hook_add_user_delete(user_delete_hook);
+	hook_add_user_sethost(user_sethost_hook);
+}
+
+void deinit_online(void)
+{
+	hook_del_user_add(user_add_hook);
+	hook_del_user_delete(user_delete_hook);
+	hook_del_user_sethost(user_sethost_hook);
+
+	mowgli_patricia_iteration_state_t state;
+	user_t *u;
+
+	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
+	{
+		online_user_remove(u);
+	}
+
+	mowgli_patricia_destroy(online_index, NULL, NULL);
+	ptrhash_destroy(&online_users);
+}
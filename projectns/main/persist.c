@@ -16,6 +16,42 @@ struct projectns_main_persist {
 
 	service_t *service;
 	mowgli_patricia_t *projects;
+
+	struct journal_state journal;
+
+	// Derived indexes, handed over as well so a same-ABI reload need not rebuild them
+	mowgli_patricia_t *channel_namespaces;
+	mowgli_patricia_t *cloak_namespaces;
+	struct ptrhash contact_index;
+
+	struct object_pools pools;
+
+	// Since PROJECTNS_MINVER_MARK_INDEX; new fields go at the end so older records stay readable
+	struct ptrhash mark_index;
+	unsigned int mark_setter_epoch;  // cached mark setters are only valid against this
+
+	// Since PROJECTNS_MINVER_KEY_INDEX
+	struct key_index project_keys;
+	struct key_index channelns_keys;
+	struct key_index cloakns_keys;
+
+	// Since PROJECTNS_MINVER_AUDIT_SETS
+	mowgli_list_t audit_sets[PROJECT_AUDIT_SETS];
+
+	// Since PROJECTNS_MINVER_ACCOUNT_INDEX; before that, account privatedata held these lists
+	struct ptrhash account_index;
+
+	// Since PROJECTNS_MINVER_HOOK_LATENCY
+	struct latency_histogram hook_latency[PROJECTNS_HOOKS];
+};
+
+// struct project_mark before PROJECTNS_MINVER_POOLS
+struct project_mark_legacy {
+	time_t time;
+	unsigned int number;
+	char *mark;
+	char *setter_id;
+	char *setter_name;
 };
 
 void persist_save_data(void)
@@ -24,10 +60,224 @@ void persist_save_data(void)
 	rec->version  = PROJECTNS_ABIREV;
 	rec->service  = projectsvs.me;
 	rec->projects = projectsvs.projects;
+	rec->journal  = journal_state;
+
+	// the next instance expects the key indexes in order
+	key_indexes_settle();
+
+	rec->channel_namespaces = projectsvs.channel_namespaces;
+	rec->cloak_namespaces   = projectsvs.cloak_namespaces;
+	projectsvs.channel_namespaces = NULL;
+	projectsvs.cloak_namespaces   = NULL;
+	contact_index_save(&rec->contact_index);
+	mark_index_save(&rec->mark_index);
+	rec->mark_setter_epoch = mark_setter_epoch;
+	rec->project_keys   = project_keys;
+	rec->channelns_keys = channelns_keys;
+	rec->cloakns_keys   = cloakns_keys;
+	init_key_indexes();
+	memcpy(rec->audit_sets, projectsvs.audit_sets, sizeof rec->audit_sets);
+	account_index_save(&rec->account_index);
+	memcpy(rec->hook_latency, projectsvs.hook_latency, sizeof rec->hook_latency);
+
+	// every object above lives in these; keep deinit_aux_structures() from freeing them
+	rec->pools = object_pools;
+	memset(&object_pools, 0, sizeof object_pools);
 
 	mowgli_global_storage_put(PERSIST_STORAGE_NAME, rec);
 }
 
+#ifdef PROJECTNS_VERIFY_RELOAD
+/* Checks the adopted reverse indexes against the per-project lists they are
+ * derived from, which is what the rebuilding path below works from.
+ */
+static bool verify_adopted_indexes(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+	mowgli_node_t *n;
+	unsigned int channelns = 0, cloakns = 0;
+	size_t contacts = 0, marks = 0;
+	size_t audit[PROJECT_AUDIT_SETS] = { 0 };
+	bool ok = true;
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+	{
+		MOWGLI_ITER_FOREACH(n, p->channel_ns.head)
+		{
+			channelns++;
+			if (mowgli_patricia_retrieve(projectsvs.channel_namespaces, n->data) != namespace_of(n) || namespace_of(n)->project != p)
+			{
+				slog(LG_ERROR, "freenode/projectns/main: reload check: channel namespace %s of %s is not indexed", (char *)n->data, p->name);
+				ok = false;
+			}
+		}
+
+		MOWGLI_ITER_FOREACH(n, p->cloak_ns.head)
+		{
+			cloakns++;
+			if (mowgli_patricia_retrieve(projectsvs.cloak_namespaces, n->data) != namespace_of(n) || namespace_of(n)->project != p)
+			{
+				slog(LG_ERROR, "freenode/projectns/main: reload check: cloak namespace %s of %s is not indexed", (char *)n->data, p->name);
+				ok = false;
+			}
+		}
+
+		MOWGLI_ITER_FOREACH(n, p->contacts.head)
+		{
+			struct project_contact *contact = n->data;
+			contacts++;
+			if (contact->project != p || contact_find(p, contact->mu) != contact || !myuser_get_projects(contact->mu)->count)
+			{
+				slog(LG_ERROR, "freenode/projectns/main: reload check: contact %s of %s is not indexed", entity(contact->mu)->name, p->name);
+				ok = false;
+			}
+		}
+
+		MOWGLI_ITER_FOREACH(n, p->marks.head)
+		{
+			struct project_mark *mark = n->data;
+			marks++;
+			if (mark_find(p, mark->number) != mark)
+			{
+				slog(LG_ERROR, "freenode/projectns/main: reload check: mark %u of %s is not indexed", mark->number, p->name);
+				ok = false;
+			}
+		}
+
+		const unsigned int audit_sets = (!p->channel_ns.count << PROJECT_AUDIT_NO_CHANNELS) | (!p->contacts.count << PROJECT_AUDIT_NO_CONTACTS);
+		if (p->audit_sets != audit_sets)
+		{
+			slog(LG_ERROR, "freenode/projectns/main: reload check: %s is in the wrong AUDIT sets", p->name);
+			ok = false;
+		}
+		for (unsigned int i = 0; i < PROJECT_AUDIT_SETS; i++)
+			if (audit_sets & (1U << i))
+				audit[i]++;
+	}
+
+	// with every listed entry found, equal sizes mean there is nothing extra in the indexes
+	if (channelns != mowgli_patricia_size(projectsvs.channel_namespaces)
+	    || cloakns != mowgli_patricia_size(projectsvs.cloak_namespaces)
+	    || contacts != contact_index_count()
+	    || contacts != account_index_count()
+	    || marks != mark_index_count()
+	    || mowgli_patricia_size(projectsvs.projects) != project_keys.count
+	    || channelns != channelns_keys.count
+	    || cloakns != cloakns_keys.count
+	    || audit[PROJECT_AUDIT_NO_CHANNELS] != projectsvs.audit_sets[PROJECT_AUDIT_NO_CHANNELS].count
+	    || audit[PROJECT_AUDIT_NO_CONTACTS] != projectsvs.audit_sets[PROJECT_AUDIT_NO_CONTACTS].count)
+	{
+		slog(LG_ERROR, "freenode/projectns/main: reload check: index sizes differ (channel %u/%u, cloak %u/%u, contacts %zu/%zu/%zu, marks %zu/%zu)",
+		     channelns, mowgli_patricia_size(projectsvs.channel_namespaces),
+		     cloakns, mowgli_patricia_size(projectsvs.cloak_namespaces),
+		     contacts, contact_index_count(), account_index_count(),
+		     marks, mark_index_count());
+		slog(LG_ERROR, "freenode/projectns/main: reload check: key index sizes (projects %u/%zu, channel %u/%zu, cloak %u/%zu)",
+		     mowgli_patricia_size(projectsvs.projects), project_keys.count,
+		     channelns, channelns_keys.count, cloakns, cloakns_keys.count);
+		slog(LG_ERROR, "freenode/projectns/main: reload check: AUDIT set sizes (no channels %zu/%zu, no contacts %zu/%zu)",
+		     audit[PROJECT_AUDIT_NO_CHANNELS], projectsvs.audit_sets[PROJECT_AUDIT_NO_CHANNELS].count,
+		     audit[PROJECT_AUDIT_NO_CONTACTS], projectsvs.audit_sets[PROJECT_AUDIT_NO_CONTACTS].count);
+		ok = false;
+	}
+
+	return ok;
+}
+
+static void rebuild_indexes(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+	mowgli_node_t *n;
+
+	mowgli_patricia_destroy(projectsvs.channel_namespaces, NULL, NULL);
+	mowgli_patricia_destroy(projectsvs.cloak_namespaces, NULL, NULL);
+	projectsvs.channel_namespaces = mowgli_patricia_create(irccasecanon);
+	projectsvs.cloak_namespaces = mowgli_patricia_create(strcasecanon);
+
+	struct ptrhash empty;
+	ptrhash_init(&empty);
+	contact_index_restore(&empty);
+	ptrhash_init(&empty);
+	mark_index_restore(&empty);
+	ptrhash_init(&empty);
+	account_index_restore(&empty);
+
+	deinit_key_indexes();
+	init_key_indexes();
+	key_indexes_defer();
+
+	// the set nodes live in the projects, so the lists can simply be started over
+	memset(projectsvs.audit_sets, 0, sizeof projectsvs.audit_sets);
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+	{
+		key_index_add(&project_keys, p->name, p);
+		p->audit_sets = 0;
+		audit_update(p);
+		MOWGLI_ITER_FOREACH(n, p->channel_ns.head)
+		{
+			namespace_of(n)->project = p;
+			mowgli_patricia_add(projectsvs.channel_namespaces, n->data, namespace_of(n));
+			key_index_add(&channelns_keys, n->data, namespace_of(n));
+		}
+		MOWGLI_ITER_FOREACH(n, p->cloak_ns.head)
+		{
+			namespace_of(n)->project = p;
+			mowgli_patricia_add(projectsvs.cloak_namespaces, n->data, namespace_of(n));
+			key_index_add(&cloakns_keys, n->data, namespace_of(n));
+		}
+		MOWGLI_ITER_FOREACH(n, p->contacts.head)
+		{
+			contact_index_add(n->data);
+			account_index_add(n->data);
+		}
+		MOWGLI_ITER_FOREACH(n, p->marks.head)
+			mark_index_add(p, n->data);
+	}
+
+	key_indexes_settle();
+}
+#endif
+
+/* Same ABI: every object is still laid out the way we expect it, so take over
+ * the old module's trees as they are instead of copying the registry.
+ */
+static void adopt_data(struct projectns_main_persist *rec)
+{
+	mowgli_patricia_destroy(projectsvs.projects, NULL, NULL);
+	mowgli_patricia_destroy(projectsvs.channel_namespaces, NULL, NULL);
+	mowgli_patricia_destroy(projectsvs.cloak_namespaces, NULL, NULL);
+
+	projectsvs.projects              = rec->projects;
+	projectsvs.channel_namespaces = rec->channel_namespaces;
+	projectsvs.cloak_namespaces   = rec->cloak_namespaces;
+	contact_index_restore(&rec->contact_index);
+	mark_index_restore(&rec->mark_index);
+	mark_setter_epoch = rec->mark_setter_epoch;
+
+	deinit_key_indexes();
+	project_keys   = rec->project_keys;
+	channelns_keys = rec->channelns_keys;
+	cloakns_keys   = rec->cloakns_keys;
+	memcpy(projectsvs.audit_sets, rec->audit_sets, sizeof projectsvs.audit_sets);
+	account_index_restore(&rec->account_index);
+
+	destroy_object_pools(&object_pools);
+	object_pools = rec->pools;
+
+	journal_state = rec->journal;
+
+#ifdef PROJECTNS_VERIFY_RELOAD
+	if (!verify_adopted_indexes())
+	{
+		slog(LG_ERROR, "freenode/projectns/main: adopted indexes are inconsistent, rebuilding them");
+		rebuild_indexes();
+	}
+#endif
+}
+
 bool persist_load_data(module_t *m)
 {
 	struct projectns_main_persist *rec = mowgli_global_storage_get(PERSIST_STORAGE_NAME);
@@ -50,52 +300,120 @@ bool persist_load_data(module_t *m)
 	slog(LG_DEBUG, "freenode/projectns/main: restoring pre-reload structures (old: %u; new: %u)", rec->version, PROJECTNS_ABIREV);
 	projectsvs.me = rec->service;
 
-	/* If rec->version == PROJECTNS_ABIREV, we could probably re-use rec->projects safely.
-	 * However, this would mean the upgrade codepath would be separate and much less tested.
+	// plain counters, so these carry over whichever way the rest is restored
+	if (rec->version >= PROJECTNS_MINVER_HOOK_LATENCY)
+		memcpy(projectsvs.hook_latency, rec->hook_latency, sizeof projectsvs.hook_latency);
+
+	if (rec->version == PROJECTNS_ABIREV)
+	{
+		adopt_data(rec);
+
+		mowgli_global_storage_free(PERSIST_STORAGE_NAME);
+		free(rec);
+		return true;
+	}
+
+	/* Older ABI: copy everything into new objects and rebuild the indexes from the
+	 * per-project lists. Build with -DPROJECTNS_VERIFY_RELOAD to have same-ABI
+	 * reloads check the adopted indexes against those same lists.
+	 */
+
+	// the indexes are keyed on pointers we are about to free; rebuild them from scratch
+	if (rec->version >= PROJECTNS_MINVER_ADOPT)
+	{
+		mowgli_patricia_destroy(rec->channel_namespaces, NULL, NULL);
+		mowgli_patricia_destroy(rec->cloak_namespaces, NULL, NULL);
+		ptrhash_destroy(&rec->contact_index);
+	}
+	if (rec->version >= PROJECTNS_MINVER_MARK_INDEX)
+		ptrhash_destroy(&rec->mark_index);
+	if (rec->version >= PROJECTNS_MINVER_KEY_INDEX)
+	{
+		key_index_destroy(&rec->project_keys);
+		key_index_destroy(&rec->channelns_keys);
+		key_index_destroy(&rec->cloakns_keys);
+	}
+	if (rec->version >= PROJECTNS_MINVER_ACCOUNT_INDEX)
+		account_index_destroy(&rec->account_index);
+
+	/* Objects were allocated individually before PROJECTNS_MINVER_POOLS. Since then
+	 * they come from the old module's pools, which are released as a whole at the end.
 	 */
+	const bool old_pools = rec->version >= PROJECTNS_MINVER_POOLS;
 
 	mowgli_patricia_iteration_state_t state;
 	struct projectns *old_p;
 
+	key_indexes_defer();
+
 	MOWGLI_PATRICIA_FOREACH(old_p, &state, rec->projects)
 	{
 		mowgli_patricia_delete(rec->projects, old_p->name);
-		struct projectns *new = smalloc(sizeof *new);
-		memset(new, 0, sizeof *new);
+		struct projectns *new = slab_alloc(&object_pools.projects);
 		new->name = old_p->name;
 		new->any_may_register = old_p->any_may_register;
 		new->reginfo = old_p->reginfo;
 
 		mowgli_patricia_add(projectsvs.projects, new->name, new);
+		key_index_add(&project_keys, new->name, new);
 
-		/* This is safe as the list metadata is copied by value;
-		 * the actual list comprises nodes of strings (channel namespaces),
-		 * which are still valid.
-		 *
-		 * We do need to restore the reverse mapping as we destroyed it
-		 * on unloading due to it having pointers that would now be stale.
+		/* Namespaces are recreated as records in our arena, which also restores
+		 * the reverse mapping. Old lists always have the name as node data;
+		 * the trees mapped to projects before PROJECTNS_MINVER_NAMESPACE_OBJECT.
 		 */
-		new->channel_ns = old_p->channel_ns;
+		mowgli_node_t *n, *tn;
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, old_p->channel_ns.head)
+		{
+			channelns_add(new, n->data);
 
-		// As above; mark structure only contains integers and char*
-		new->marks      = old_p->marks;
+			if (!old_pools)
+			{
+				free(n->data);
+				mowgli_node_delete(n, &old_p->channel_ns);
+				mowgli_node_free(n);
+			}
+		}
 
-		mowgli_node_t *n, *tn;
-		MOWGLI_ITER_FOREACH(n, new->channel_ns.head)
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, old_p->marks.head)
 		{
-			mowgli_patricia_add(projectsvs.projects_by_channelns, n->data, new);
+			if (old_pools)
+			{
+				struct project_mark *mark = n->data;
+				mark_new(new, mark->number, mark->time, mark->setter_id, mark->setter_name, mark->mark);
+				free(mark->setter_id);
+				free(mark->setter_name);
+				free(mark->mark);
+			}
+			else
+			{
+				struct project_mark_legacy *mark = n->data;
+				mark_new(new, mark->number, mark->time, mark->setter_id, mark->setter_name, mark->mark);
+				free(mark->setter_id);
+				free(mark->setter_name);
+				free(mark->mark);
+				free(mark);
+
+				mowgli_node_delete(n, &old_p->marks);
+				mowgli_node_free(n);
+			}
 		}
 
 		if (rec->version >= PROJECTNS_MINVER_CONTACT_OBJECT)
 		{
-			// the list still holds valid objects
-			new->contacts = old_p->contacts;
-
-			MOWGLI_ITER_FOREACH(n, new->contacts.head)
+			MOWGLI_ITER_FOREACH_SAFE(n, tn, old_p->contacts.head)
 			{
-				struct project_contact *contact = n->data;
-				contact->project = new;
-				// the nodes are still in their proper lists
+				struct project_contact *old_contact = n->data;
+
+				// swap the old object in the account's list for a new one
+				if (rec->version < PROJECTNS_MINVER_ACCOUNT_INDEX)
+					mowgli_node_delete(&old_contact->myuser_n, privatedata_get(old_contact->mu, MYUSER_PRIVDATA_NAME));
+
+				struct project_contact *contact = contact_new(new, old_contact->mu);
+				contact->visible   = old_contact->visible;
+				contact->secondary = old_contact->secondary;
+
+				if (!old_pools)
+					free(old_contact);
 			}
 		}
 		else
@@ -107,38 +425,82 @@ bool persist_load_data(module_t *m)
 				mowgli_node_delete(n, &old_p->contacts);
 				mowgli_node_free(n);
 
-				struct project_contact *contact = smalloc(sizeof *contact);
-				contact->project = new;
-				contact->mu      = mu;
-
-				mowgli_node_add(contact, &contact->myuser_n,  myuser_get_projects(contact->mu));
-				mowgli_node_add(contact, &contact->project_n, &new->contacts);
+				contact_new(new, mu);
 			}
 		}
 
 		if (rec->version >= PROJECTNS_MINVER_CLOAKNS)
 		{
-			new->cloak_ns = old_p->cloak_ns;
-
-			MOWGLI_ITER_FOREACH(n, new->cloak_ns.head)
+			MOWGLI_ITER_FOREACH_SAFE(n, tn, old_p->cloak_ns.head)
 			{
-				mowgli_patricia_add(projectsvs.projects_by_cloakns, n->data, new);
+				cloakns_add(new, n->data);
+
+				if (!old_pools)
+				{
+					free(n->data);
+					mowgli_node_delete(n, &old_p->cloak_ns);
+					mowgli_node_free(n);
+				}
 			}
 		}
 
+		// before PROJECTNS_MINVER_MARK_INDEX, the marks copied above are all we know of
+		if (rec->version >= PROJECTNS_MINVER_MARK_INDEX && old_p->last_mark_id > new->last_mark_id)
+			new->last_mark_id = old_p->last_mark_id;
+
 		if (rec->version >= PROJECTNS_MINVER_CREATION_MD)
 		{
 			new->creator       = old_p->creator;
 			new->creation_time = old_p->creation_time;
 		}
 
+		// the old module's AUDIT sets link the old objects; file the new one afresh
+		audit_update(new);
+
+		// cached output is simply rebuilt on demand
+		if (rec->version >= PROJECTNS_MINVER_RENDER)
+			render_forget(old_p);
+
 		/* If you wish to restore anything else, it will not have been there
 		 * in past versions, so you *must* check rec->version to see whether
 		 * the data is present or you *will* cause a crash or worse.
 		 */
-		free(old_p);
+		if (!old_pools)
+			free(old_p);
 	}
 
+	// drop the lists older modules kept in account privatedata; contacts are now in our account index
+	if (rec->version < PROJECTNS_MINVER_ACCOUNT_INDEX)
+	{
+		myentity_iteration_state_t mestate;
+		myentity_t *mt;
+
+		MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+		{
+			mowgli_list_t *l = privatedata_delete(mt, MYUSER_PRIVDATA_NAME);
+			if (!l)
+				continue;
+
+			// entries are embedded in the contacts since PROJECTNS_MINVER_CONTACT_OBJECT
+			mowgli_node_t *n, *tn;
+			MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+			{
+				mowgli_node_delete(n, l);
+				if (rec->version < PROJECTNS_MINVER_CONTACT_OBJECT)
+					mowgli_node_free(n);
+			}
+			mowgli_list_free(l);
+		}
+	}
+
+	key_indexes_settle();
+
+	if (old_pools)
+		destroy_object_pools(&rec->pools);
+
+	if (rec->version >= PROJECTNS_MINVER_JOURNAL)
+		journal_state = rec->journal;
+
 	// don't pass a destructor callback; we took care of everything while iterating
 	mowgli_patricia_destroy(rec->projects, NULL, NULL);
 
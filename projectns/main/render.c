@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Cached rendering of project details
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* The namespace and contact lists shown by INFO and by the NickServ/ChanServ
+ * INFO hooks are built once per project and view, split into chunks of about
+ * one line each, and reused until project_touch() bumps the project's
+ * generation. Only the list text is cached; callers still apply their own
+ * (translatable) line formats when sending, and spell out the annotations
+ * stored as PROJECT_RENDER_MARKED and PROJECT_RENDER_SECONDARY.
+ */
+
+struct chunk_builder {
+	struct project_render_section *section;
+	char buf[BUFSIZE];
+	size_t len;
+};
+
+static void chunk_flush(struct chunk_builder *b)
+{
+	if (!b->len)
+		return;
+
+	struct project_render_section *s = b->section;
+
+	s->chunks = srealloc(s->chunks, (s->nchunks + 1) * sizeof *s->chunks);
+	s->chunks[s->nchunks++] = sstrdup(b->buf);
+
+	b->buf[0] = '\0';
+	b->len = 0;
+}
+
+static void chunk_append(struct chunk_builder *b, const char *text)
+{
+	size_t n = mowgli_strlcpy(b->buf + b->len, text, sizeof b->buf - b->len);
+
+	b->len += n < sizeof b->buf - b->len ? n : sizeof b->buf - b->len - 1;
+}
+
+// Starts a new line once the current one is long enough, then separates items with ", "
+static void chunk_next_item(struct chunk_builder *b)
+{
+	if (b->len > 80)
+		chunk_flush(b);
+	else if (b->len)
+		chunk_append(b, ", ");
+
+	b->section->items++;
+}
+
+static void chunk_start(struct chunk_builder *b, struct project_render_section *section)
+{
+	b->section = section;
+	b->buf[0]  = '\0';
+	b->len     = 0;
+}
+
+static void render_contacts(struct chunk_builder *b, struct projectns *p, bool visible, bool annotate_secondary)
+{
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, p->contacts.head)
+	{
+		struct project_contact *c = n->data;
+		if (c->visible != visible)
+			continue;
+
+		chunk_next_item(b);
+		chunk_append(b, entity(c->mu)->name);
+
+		if (annotate_secondary && c->secondary)
+			chunk_append(b, (const char[]){ PROJECT_RENDER_SECONDARY, '\0' });
+	}
+	chunk_flush(b);
+}
+
+static void render_info_contacts(struct chunk_builder *b, struct projectns *p, bool secondary, bool visible)
+{
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, p->contacts.head)
+	{
+		struct project_contact *c = n->data;
+		if (c->secondary != secondary || c->visible != visible)
+			continue;
+
+		chunk_next_item(b);
+		chunk_append(b, entity(c->mu)->name);
+	}
+	chunk_flush(b);
+}
+
+static void render_namespaces(struct chunk_builder *b, mowgli_list_t *list)
+{
+	mowgli_node_t *n;
+	MOWGLI_ITER_FOREACH(n, list->head)
+	{
+		chunk_next_item(b);
+		chunk_append(b, n->data);
+	}
+	chunk_flush(b);
+}
+
+// "[MARKED; ]#chan, #chan2; cloak/*, cloak2/*" as shown by NickServ INFO
+static void render_userinfo(struct chunk_builder *b, struct projectns *p, bool priv)
+{
+	mowgli_node_t *n;
+	bool channels_need_separator = false;
+
+	if (priv && p->marks.head != NULL)
+	{
+		chunk_append(b, (const char[]){ PROJECT_RENDER_MARKED, '\0' });
+		channels_need_separator = true;
+	}
+
+	bool cloaks_need_separator = channels_need_separator;
+
+	MOWGLI_ITER_FOREACH(n, p->channel_ns.head)
+	{
+		if (b->len > 80)
+		{
+			chunk_flush(b);
+			channels_need_separator = false;
+		}
+		if (b->len)
+		{
+			chunk_append(b, channels_need_separator ? "; " : ", ");
+			channels_need_separator = false;
+		}
+		chunk_append(b, n->data);
+		b->section->items++;
+		cloaks_need_separator = true;
+	}
+
+	MOWGLI_ITER_FOREACH(n, p->cloak_ns.head)
+	{
+		if (b->len > 80)
+		{
+			chunk_flush(b);
+			cloaks_need_separator = false;
+		}
+		if (b->len)
+		{
+			chunk_append(b, cloaks_need_separator ? "; " : ", ");
+			cloaks_need_separator = false;
+		}
+		chunk_append(b, n->data);
+		chunk_append(b, "/*");
+		b->section->items++;
+	}
+
+	chunk_flush(b);
+}
+
+static void render_free(struct project_render *r)
+{
+	for (unsigned int i = 0; i < PROJECT_RENDER_MAX_SECTIONS; i++)
+	{
+		for (unsigned int j = 0; j < r->sections[i].nchunks; j++)
+			free(r->sections[i].chunks[j]);
+		free(r->sections[i].chunks);
+	}
+
+	free(r);
+}
+
+static struct project_render *render_build(struct projectns *p, enum project_render_view view)
+{
+	struct project_render *r = scalloc(1, sizeof *r);
+	struct chunk_builder b;
+
+	r->generation = p->generation;
+
+	switch (view)
+	{
+		case PROJECT_RENDER_USERINFO:
+		case PROJECT_RENDER_USERINFO_PRIV:
+			chunk_start(&b, &r->sections[0]);
+			render_userinfo(&b, p, view == PROJECT_RENDER_USERINFO_PRIV);
+			break;
+
+		case PROJECT_RENDER_CHANINFO:
+			chunk_start(&b, &r->sections[PROJECT_RENDER_CHANINFO_PUBLIC]);
+			render_contacts(&b, p, true, false);
+			break;
+
+		case PROJECT_RENDER_CHANINFO_PRIV:
+			chunk_start(&b, &r->sections[PROJECT_RENDER_CHANINFO_PUBLIC]);
+			render_contacts(&b, p, true, true);
+			chunk_start(&b, &r->sections[PROJECT_RENDER_CHANINFO_UNLISTED]);
+			render_contacts(&b, p, false, true);
+			break;
+
+		case PROJECT_RENDER_INFO:
+			chunk_start(&b, &r->sections[PROJECT_RENDER_INFO_CHANNELS]);
+			render_namespaces(&b, &p->channel_ns);
+			chunk_start(&b, &r->sections[PROJECT_RENDER_INFO_CLOAKS]);
+			render_namespaces(&b, &p->cloak_ns);
+			chunk_start(&b, &r->sections[PROJECT_RENDER_INFO_GROUP_PUBLIC]);
+			render_info_contacts(&b, p, false, true);
+			chunk_start(&b, &r->sections[PROJECT_RENDER_INFO_GROUP_PRIVATE]);
+			render_info_contacts(&b, p, false, false);
+			chunk_start(&b, &r->sections[PROJECT_RENDER_INFO_SECONDARY_PUBLIC]);
+			render_info_contacts(&b, p, true, true);
+			chunk_start(&b, &r->sections[PROJECT_RENDER_INFO_SECONDARY_PRIVATE]);
+			render_info_contacts(&b, p, true, false);
+			break;
+
+		default:
+			break;
+	}
+
+	return r;
+}
+
+const struct project_render *project_render(struct projectns * const p, const enum project_render_view view)
+{
+	struct project_render *r = p->render[view];
+
+	if (r && r->generation == p->generation)
+		return r;
+
+	if (r)
+		render_free(r);
+
+	return p->render[view] = render_build(p, view);
+}
+
+void render_forget(struct projectns * const p)
+{
+	for (unsigned int i = 0; i < PROJECT_RENDER_VIEWS; i++)
+	{
+		if (p->render[i])
+			render_free(p->render[i]);
+		p->render[i] = NULL;
+	}
+}
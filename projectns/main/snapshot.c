@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Binary registry snapshots
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Layout (native byte order, checked through the byteorder field):
+ *
+ *   struct snap_header
+ *   struct snap_project   [nprojects]
+ *   struct snap_contact   [ncontacts]
+ *   struct snap_mark      [nmarks]
+ *   struct snap_namespace [nchannelns]
+ *   struct snap_namespace [ncloakns]
+ *   string table          [strtab_size]
+ *
+ * Child records are stored in the same order as their projects, each project
+ * record carrying its child counts, so the loader can rebuild everything in a
+ * single pass without looking any project up by name. Strings are referenced
+ * by offset into the string table; SNAP_NOSTR stands for NULL.
+ */
+
+#define SNAP_MAGIC     0x504e5342U /* "PNSB" */
+#define SNAP_VERSION   2U
+#define SNAP_BYTEORDER 0x01020304U
+#define SNAP_NOSTR     UINT32_MAX
+
+#define SNAP_PROJECT_OPENREG   0x1U
+#define SNAP_CONTACT_VISIBLE   0x1U
+#define SNAP_CONTACT_SECONDARY 0x2U
+
+struct snap_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t seq;
+	uint32_t nprojects;
+	uint32_t ncontacts;
+	uint32_t nmarks;
+	uint32_t nchannelns;
+	uint32_t ncloakns;
+	uint32_t strtab_size;
+};
+
+struct snap_project {
+	int64_t creation_time;
+	uint32_t name;
+	uint32_t reginfo;
+	uint32_t creator;
+	uint32_t flags;
+	uint32_t ncontacts;
+	uint32_t nmarks;
+	uint32_t nchannelns;
+	uint32_t ncloakns;
+	uint32_t last_mark_id;
+	uint32_t reserved;
+};
+
+struct snap_contact {
+	uint32_t account;
+	uint32_t flags;
+};
+
+struct snap_mark {
+	int64_t time;
+	uint32_t number;
+	uint32_t setter_id;
+	uint32_t setter_name;
+	uint32_t text;
+};
+
+struct snap_namespace {
+	uint32_t name;
+};
+
+// A growing byte buffer, used both for the string table and for each record section
+struct snapbuf {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+static void snapbuf_append(struct snapbuf * const sb, const void * const data, const size_t len)
+{
+	if (sb->len + len > sb->size)
+	{
+		while (sb->len + len > sb->size)
+			sb->size = sb->size ? sb->size * 2 : 65536;
+		sb->buf = srealloc(sb->buf, sb->size);
+	}
+
+	memcpy(sb->buf + sb->len, data, len);
+	sb->len += len;
+}
+
+static uint32_t strtab_add(struct snapbuf * const st, const char * const s)
+{
+	if (!s)
+		return SNAP_NOSTR;
+
+	uint32_t off = st->len;
+	snapbuf_append(st, s, strlen(s) + 1);
+
+	return off;
+}
+
+/* Sections are kept in memory until the snapshot is finished, so projects can
+ * be added a few at a time (as journal compaction does) even though each
+ * section spans the whole registry.
+ */
+struct snapshot_writer {
+	char *path;
+	struct snap_header hdr;
+	struct snapbuf projects;
+	struct snapbuf contacts;
+	struct snapbuf marks;
+	struct snapbuf channelns;
+	struct snapbuf cloakns;
+	struct snapbuf strtab;
+};
+
+struct snapshot_writer *snapshot_begin(const char * const path, const unsigned int seq)
+{
+	struct snapshot_writer *sw = scalloc(1, sizeof *sw);
+
+	sw->path = sstrdup(path);
+	sw->hdr.magic     = SNAP_MAGIC;
+	sw->hdr.version   = SNAP_VERSION;
+	sw->hdr.byteorder = SNAP_BYTEORDER;
+	sw->hdr.seq       = seq;
+
+	return sw;
+}
+
+void snapshot_add_project(struct snapshot_writer * const sw, const struct projectns * const p)
+{
+	struct snapbuf * const st = &sw->strtab;
+	mowgli_node_t *n;
+
+	struct snap_project prec = {
+		.creation_time = p->creation_time,
+		.name          = strtab_add(st, p->name),
+		.reginfo       = strtab_add(st, p->reginfo),
+		.creator       = strtab_add(st, p->creator),
+		.flags         = p->any_may_register ? SNAP_PROJECT_OPENREG : 0,
+		.ncontacts     = p->contacts.count,
+		.nmarks        = p->marks.count,
+		.nchannelns    = p->channel_ns.count,
+		.ncloakns      = p->cloak_ns.count,
+		.last_mark_id  = p->last_mark_id,
+	};
+	snapbuf_append(&sw->projects, &prec, sizeof prec);
+
+	MOWGLI_ITER_FOREACH(n, p->contacts.head)
+	{
+		struct project_contact *c = n->data;
+		struct snap_contact rec = {
+			.account = strtab_add(st, entity(c->mu)->name),
+			.flags   = (c->visible ? SNAP_CONTACT_VISIBLE : 0) | (c->secondary ? SNAP_CONTACT_SECONDARY : 0),
+		};
+		snapbuf_append(&sw->contacts, &rec, sizeof rec);
+	}
+
+	MOWGLI_ITER_FOREACH(n, p->marks.head)
+	{
+		struct project_mark *m = n->data;
+		struct snap_mark rec = {
+			.time        = m->time,
+			.number      = m->number,
+			.setter_id   = strtab_add(st, m->setter_id),
+			.setter_name = strtab_add(st, m->setter_name),
+			.text        = strtab_add(st, m->mark),
+		};
+		snapbuf_append(&sw->marks, &rec, sizeof rec);
+	}
+
+	MOWGLI_ITER_FOREACH(n, p->channel_ns.head)
+	{
+		struct snap_namespace rec = { .name = strtab_add(st, n->data) };
+		snapbuf_append(&sw->channelns, &rec, sizeof rec);
+	}
+
+	MOWGLI_ITER_FOREACH(n, p->cloak_ns.head)
+	{
+		struct snap_namespace rec = { .name = strtab_add(st, n->data) };
+		snapbuf_append(&sw->cloakns, &rec, sizeof rec);
+	}
+
+	sw->hdr.nprojects++;
+	sw->hdr.ncontacts  += p->contacts.count;
+	sw->hdr.nmarks     += p->marks.count;
+	sw->hdr.nchannelns += p->channel_ns.count;
+	sw->hdr.ncloakns   += p->cloak_ns.count;
+}
+
+static void snapshot_writer_free(struct snapshot_writer * const sw)
+{
+	free(sw->projects.buf);
+	free(sw->contacts.buf);
+	free(sw->marks.buf);
+	free(sw->channelns.buf);
+	free(sw->cloakns.buf);
+	free(sw->strtab.buf);
+	free(sw->path);
+	free(sw);
+}
+
+void snapshot_abort(struct snapshot_writer * const sw)
+{
+	snapshot_writer_free(sw);
+}
+
+// Writes out everything added so far and renames it into place; frees the writer either way
+bool snapshot_finish(struct snapshot_writer * const sw)
+{
+	char tmppath[BUFSIZE];
+	snprintf(tmppath, sizeof tmppath, "%s.new", sw->path);
+
+	FILE *f = fopen(tmppath, "wb");
+	if (!f)
+	{
+		slog(LG_ERROR, "snapshot_finish(): cannot open %s: %s", tmppath, strerror(errno));
+		snapshot_writer_free(sw);
+		return false;
+	}
+
+	sw->hdr.strtab_size = sw->strtab.len;
+
+	const struct snapbuf * const sections[] = {
+		&sw->projects, &sw->contacts, &sw->marks, &sw->channelns, &sw->cloakns, &sw->strtab,
+	};
+
+	fwrite(&sw->hdr, sizeof sw->hdr, 1, f);
+	for (size_t i = 0; i < sizeof sections / sizeof sections[0]; i++)
+		if (sections[i]->len)
+			fwrite(sections[i]->buf, sections[i]->len, 1, f);
+
+	if (fflush(f) != 0 || ferror(f) || fsync(fileno(f)) != 0)
+	{
+		slog(LG_ERROR, "snapshot_finish(): error writing %s: %s", tmppath, strerror(errno));
+		fclose(f);
+		unlink(tmppath);
+		snapshot_writer_free(sw);
+		return false;
+	}
+	fclose(f);
+
+	if (rename(tmppath, sw->path) != 0)
+	{
+		slog(LG_ERROR, "snapshot_finish(): cannot rename %s to %s: %s", tmppath, sw->path, strerror(errno));
+		unlink(tmppath);
+		snapshot_writer_free(sw);
+		return false;
+	}
+
+	snapshot_writer_free(sw);
+	return true;
+}
+
+// Writes the whole registry at once
+bool snapshot_write(const char * const path, const unsigned int seq)
+{
+	struct snapshot_writer *sw = snapshot_begin(path, seq);
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+	{
+		snapshot_add_project(sw, p);
+	}
+
+	return snapshot_finish(sw);
+}
+
+static inline bool snap_str_ok(const uint32_t strtab_size, const uint32_t off, const bool optional)
+{
+	return (optional && off == SNAP_NOSTR) || off < strtab_size;
+}
+
+// Only valid once snapshot_validate_records() has checked every reference
+static inline const char *snap_str(const char * const strtab, const uint32_t off)
+{
+	return off == SNAP_NOSTR ? NULL : strtab + off;
+}
+
+static bool snapshot_validate_size(const struct snap_header * const hdr, const size_t size)
+{
+	if (size < sizeof *hdr || hdr->magic != SNAP_MAGIC || hdr->byteorder != SNAP_BYTEORDER || hdr->version != SNAP_VERSION)
+		return false;
+
+	uint64_t need = sizeof *hdr;
+	need += (uint64_t)hdr->nprojects  * sizeof(struct snap_project);
+	need += (uint64_t)hdr->ncontacts  * sizeof(struct snap_contact);
+	need += (uint64_t)hdr->nmarks     * sizeof(struct snap_mark);
+	need += (uint64_t)hdr->nchannelns * sizeof(struct snap_namespace);
+	need += (uint64_t)hdr->ncloakns   * sizeof(struct snap_namespace);
+	need += hdr->strtab_size;
+
+	return need == size;
+}
+
+// Checks child counts and every string reference, so loading is all-or-nothing
+static bool snapshot_validate_records(const struct snap_header * const hdr, const struct snap_project * const prec,
+                                      const struct snap_contact * const crec, const struct snap_mark * const mrec,
+                                      const struct snap_namespace * const chrec, const struct snap_namespace * const clrec,
+                                      const char * const strtab)
+{
+	const uint32_t sz = hdr->strtab_size;
+
+	if (sz && strtab[sz - 1] != '\0')
+		return false;
+
+	uint64_t ncontacts = 0, nmarks = 0, nchannelns = 0, ncloakns = 0;
+	for (uint32_t i = 0; i < hdr->nprojects; i++)
+	{
+		if (!snap_str_ok(sz, prec[i].name, false) || !snap_str_ok(sz, prec[i].reginfo, true) || !snap_str_ok(sz, prec[i].creator, true))
+			return false;
+
+		ncontacts  += prec[i].ncontacts;
+		nmarks     += prec[i].nmarks;
+		nchannelns += prec[i].nchannelns;
+		ncloakns   += prec[i].ncloakns;
+	}
+
+	if (ncontacts != hdr->ncontacts || nmarks != hdr->nmarks || nchannelns != hdr->nchannelns || ncloakns != hdr->ncloakns)
+		return false;
+
+	for (uint32_t i = 0; i < hdr->ncontacts; i++)
+		if (!snap_str_ok(sz, crec[i].account, false))
+			return false;
+
+	for (uint32_t i = 0; i < hdr->nmarks; i++)
+		if (!snap_str_ok(sz, mrec[i].text, false) || !snap_str_ok(sz, mrec[i].setter_id, false) || !snap_str_ok(sz, mrec[i].setter_name, false))
+			return false;
+
+	for (uint32_t i = 0; i < hdr->nchannelns; i++)
+		if (!snap_str_ok(sz, chrec[i].name, false))
+			return false;
+
+	for (uint32_t i = 0; i < hdr->ncloakns; i++)
+		if (!snap_str_ok(sz, clrec[i].name, false))
+			return false;
+
+	return true;
+}
+
+// Loads a binary snapshot into the (empty) registry.
+// Returns false without touching anything if the file is missing or unusable.
+bool snapshot_load(const char * const path, unsigned int * const seq)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat sb;
+	if (fstat(fd, &sb) != 0 || sb.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	const size_t size = sb.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		slog(LG_ERROR, "snapshot_load(): cannot map %s: %s", path, strerror(errno));
+		return false;
+	}
+
+	const struct snap_header *hdr = map;
+	if (!snapshot_validate_size(hdr, size))
+	{
+		slog(LG_ERROR, "snapshot_load(): %s is not a usable snapshot, ignoring it", path);
+		munmap(map, size);
+		return false;
+	}
+
+	const struct snap_project   *prec  = (const void *)(hdr + 1);
+	const struct snap_contact   *crec  = (const void *)(prec + hdr->nprojects);
+	const struct snap_mark      *mrec  = (const void *)(crec + hdr->ncontacts);
+	const struct snap_namespace *chrec = (const void *)(mrec + hdr->nmarks);
+	const struct snap_namespace *clrec = chrec + hdr->nchannelns;
+	const char *strtab = (const char *)(clrec + hdr->ncloakns);
+
+	if (!snapshot_validate_records(hdr, prec, crec, mrec, chrec, clrec, strtab))
+	{
+		slog(LG_ERROR, "snapshot_load(): %s is corrupt, ignoring it", path);
+		munmap(map, size);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < hdr->nprojects; i++)
+	{
+		struct projectns *p = project_new(snap_str(strtab, prec[i].name));
+		p->any_may_register = prec[i].flags & SNAP_PROJECT_OPENREG;
+		p->last_mark_id     = prec[i].last_mark_id;
+
+		const char *s;
+		if ((s = snap_str(strtab, prec[i].reginfo)))
+			p->reginfo = sstrdup(s);
+		project_set_creation(p, prec[i].creation_time, snap_str(strtab, prec[i].creator));
+
+		for (uint32_t j = 0; j < prec[i].ncontacts; j++, crec++)
+		{
+			const char *account = snap_str(strtab, crec->account);
+			myuser_t *mu = myuser_find(account);
+			if (!mu)
+			{
+				slog(LG_ERROR, "snapshot_load(): ignoring contact for nonexistent account \2%s\2 on project \2%s\2", account, p->name);
+				continue;
+			}
+
+			struct project_contact *c = contact_new(p, mu);
+			if (c)
+			{
+				c->visible   = crec->flags & SNAP_CONTACT_VISIBLE;
+				c->secondary = crec->flags & SNAP_CONTACT_SECONDARY;
+			}
+		}
+
+		for (uint32_t j = 0; j < prec[i].nmarks; j++, mrec++)
+		{
+			mark_new(p, mrec->number, mrec->time, snap_str(strtab, mrec->setter_id),
+			         snap_str(strtab, mrec->setter_name), snap_str(strtab, mrec->text));
+		}
+
+		for (uint32_t j = 0; j < prec[i].nchannelns; j++, chrec++)
+		{
+			channelns_add(p, snap_str(strtab, chrec->name));
+		}
+
+		for (uint32_t j = 0; j < prec[i].ncloakns; j++, clrec++)
+		{
+			cloakns_add(p, snap_str(strtab, clrec->name));
+		}
+	}
+
+	*seq = hdr->seq;
+	munmap(map, size);
+
+	return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Core functionality - Memory and index accounting
+ */
+
+#include "fn-compat.h"
+#include "main.h"
+
+/* Byte counts are estimates: objects and tables are counted at their allocated
+ * size, strings at their length plus terminator, and patricia trees, whose
+ * internals mowgli does not expose, at PATRICIA_KEY_BYTES per key (one leaf and
+ * about one branch node) plus the canonicalized key. Allocator overhead is not
+ * included.
+ */
+
+#define PATRICIA_KEY_BYTES (sizeof(void *) * 24)
+
+static size_t string_bytes(const char * const s)
+{
+	return s ? strlen(s) + 1 : 0;
+}
+
+static size_t key_bytes(const struct key_index * const ki)
+{
+	size_t bytes = 0;
+
+	for (size_t i = 0; i < ki->count; i++)
+		bytes += strlen(ki->entries[i].key) + 1;
+
+	return bytes;
+}
+
+static size_t patricia_bytes(mowgli_patricia_t * const tree, const struct key_index * const keys)
+{
+	return mowgli_patricia_size(tree) * PATRICIA_KEY_BYTES + key_bytes(keys);
+}
+
+static void show_line(sourceinfo_t *si, const char * const what, const size_t count, const size_t bytes)
+{
+	command_success_nodata(si, _("%-22s %8zu entries, %10zu bytes"), what, count, bytes);
+}
+
+void show_registry_stats(sourceinfo_t *si)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct projectns *p;
+	mowgli_node_t *n;
+	size_t name_bytes = 0, reginfo_bytes = 0, reginfos = 0, mark_bytes = 0;
+
+	MOWGLI_PATRICIA_FOREACH(p, &state, projectsvs.projects)
+	{
+		name_bytes += string_bytes(p->name);
+
+		if (p->reginfo)
+		{
+			reginfos++;
+			reginfo_bytes += string_bytes(p->reginfo);
+		}
+
+		MOWGLI_ITER_FOREACH(n, p->marks.head)
+		{
+			struct project_mark *mark = n->data;
+			mark_bytes += string_bytes(mark->mark) + string_bytes(mark->setter_id) + string_bytes(mark->setter_name);
+		}
+	}
+
+	const size_t projects  = mowgli_patricia_size(projectsvs.projects);
+	const size_t contacts  = contact_index_count();
+	const size_t marks     = mark_index_count();
+	const size_t channelns = mowgli_patricia_size(projectsvs.channel_namespaces);
+	const size_t cloakns   = mowgli_patricia_size(projectsvs.cloak_namespaces);
+
+	command_success_nodata(si, _("Objects:"));
+	show_line(si, "projects", projects, projects * sizeof(struct projectns) + name_bytes);
+	show_line(si, "contacts", contacts, contacts * sizeof(struct project_contact));
+	show_line(si, "marks", marks, marks * sizeof(struct project_mark) + mark_bytes);
+	show_line(si, "channel namespaces", channelns, channelns * sizeof(struct project_namespace) + key_bytes(&channelns_keys));
+	show_line(si, "cloak namespaces", cloakns, cloakns * sizeof(struct project_namespace) + key_bytes(&cloakns_keys));
+	show_line(si, "reginfo strings", reginfos, reginfo_bytes);
+
+	size_t contact_bytes, mark_index_bytes, account_bytes;
+	object_index_bytes(&contact_bytes, &mark_index_bytes, &account_bytes);
+
+	command_success_nodata(si, _("Indexes:"));
+	show_line(si, "projects tree", projects, patricia_bytes(projectsvs.projects, &project_keys));
+	show_line(si, "channel namespace tree", channelns, patricia_bytes(projectsvs.channel_namespaces, &channelns_keys));
+	show_line(si, "cloak namespace tree", cloakns, patricia_bytes(projectsvs.cloak_namespaces, &cloakns_keys));
+	show_line(si, "project keys", project_keys.count, project_keys.size * sizeof *project_keys.entries);
+	show_line(si, "channel keys", channelns_keys.count, channelns_keys.size * sizeof *channelns_keys.entries);
+	show_line(si, "cloak keys", cloakns_keys.count, cloakns_keys.size * sizeof *cloakns_keys.entries);
+	show_line(si, "contact index", contacts, contact_bytes);
+	show_line(si, "account contact lists", contacts, account_bytes);
+	show_line(si, "mark index", marks, mark_index_bytes);
+
+	const size_t creation_bytes = creation_index_bytes();
+	show_line(si, "creation index", creation_bytes ? projects : 0, creation_bytes);
+
+	command_success_nodata(si, _("Namespace arena: %zu bytes in use of %zu reserved"),
+	                       object_pools.namespaces.live_bytes, object_pools.namespaces.reserved);
+
+	if (db_write_stats.time)
+		command_success_nodata(si, _("Last database write: %u rows to the %s in %.3f ms, %s ago"),
+		                       db_write_stats.rows, db_write_stats.journal ? _("journal") : _("services database"),
+		                       db_write_stats.duration_ms, time_ago(db_write_stats.time));
+	else
+		command_success_nodata(si, _("Last database write: none since loading"));
+}
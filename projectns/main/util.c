@@ -19,7 +19,7 @@ bool is_valid_project_name(const char * const name)
 	 */
 	for (const char *c = name; *c; c++)
 	{
-		if (!isprint(*c) || *c == ' ' || *c == '\n' || *c == '\r')
+		if (!isprint((unsigned char)*c) || *c == ' ' || *c == '\n' || *c == '\r')
 		{
 			return false;
 		}
@@ -27,68 +27,96 @@ bool is_valid_project_name(const char * const name)
 	return !(strlen(name) >= PROJECTNAMELEN);
 }
 
-// Remove the last -suffix from a channel name by replacing the separator with a NUL.
-// Returns false if there was no -suffix to remove.
-static bool trim_last_component(char *chan)
+/* Names that commands writing to or reading from the data directory must never
+ * touch: the services database and configuration, and this module's snapshot
+ * and journal files (see journal.c). Anything starting with one is refused.
+ */
+static const char * const reserved_data_files[] = {
+	"atheme.",
+	"services.db",
+	"projectns.",
+};
+
+// Screens a user-supplied file name for the data directory: a plain name (no
+// path components, hidden files or nonprintables) ending in the given suffix,
+// which is not one of the reserved files above.
+bool is_valid_data_file_name(const char * const name, const char * const suffix)
 {
-	for (size_t i = strlen(chan) - 1; i > 0; i--)
+	const size_t len = strlen(name), suffixlen = strlen(suffix);
+
+	if (len <= suffixlen || len >= BUFSIZE / 2 || strcmp(name + len - suffixlen, suffix) != 0)
+		return false;
+
+	if (name[0] == '.')
+		return false;
+
+	for (const char *c = name; *c; c++)
 	{
-		if (strchr(projectsvs.config.namespace_separators, chan[i]))
-		{
-			chan[i] = '\0';
-			return true;
-		}
+		if (!isprint((unsigned char)*c) || *c == '/' || *c == ' ')
+			return false;
 	}
 
-	return false;
+	for (size_t i = 0; i < sizeof reserved_data_files / sizeof reserved_data_files[0]; i++)
+	{
+		if (strncasecmp(name, reserved_data_files[i], strlen(reserved_data_files[i])) == 0)
+			return false;
+	}
+
+	return true;
 }
 
 // Looks up a project by channel name.
-// If out_namespace is a non-NULL pointer to char*, it will be set to point
-// at a buffer containing the channel namespace that was matched, and the caller
-// will have to free() it later.
+// The name is scanned once, recording every position where a namespace could
+// end (i.e. every separator after the first character); the candidates are
+// then tried from longest to shortest, so the longest registered namespace wins.
+//
+// If out_namespace is non-NULL, it will receive the channel namespace that was
+// matched, truncated to namespace_len bytes.
 //
 // If no project is found, NULL is returned and out_namespace is left untouched.
-// Callers that wish to free *out_namespace either way may set it to NULL beforehand.
-struct projectns *channame_get_project(const char * const name, char **out_namespace)
+struct projectns *channame_get_project(const char * const name, char *out_namespace, size_t namespace_len)
 {
-	char *buf = sstrdup(name);
-
-	struct projectns *p = NULL;
+	char buf[CHANNELLEN];
+	unsigned short cuts[CHANNELLEN];
+	size_t len, ncuts = 0;
 
-	do {
-		p = mowgli_patricia_retrieve(projectsvs.projects_by_channelns, buf);
-		if (p)
-			break;
-	} while (trim_last_component(buf));
+	for (len = 0; name[len] && len < sizeof buf - 1; len++)
+	{
+		buf[len] = name[len];
+		if (len > 0 && namespace_separator_map[(unsigned char)name[len]])
+			cuts[ncuts++] = len;
+	}
+	buf[len] = '\0';
 
-	if (out_namespace && p)
-		*out_namespace = buf;
-	else
-		free(buf);
+	struct project_namespace *ns = NULL;
 
-	return p;
-}
+	// Names too long to be a namespace themselves can still have one as a prefix
+	if (name[len] == '\0')
+		ns = channelns_find(buf);
 
-mowgli_list_t *myuser_get_projects(myuser_t *mu)
-{
-	mowgli_list_t *l;
+	while (!ns && ncuts > 0)
+	{
+		buf[cuts[--ncuts]] = '\0';
+		ns = channelns_find(buf);
+	}
 
-	l = privatedata_get(mu, MYUSER_PRIVDATA_NAME);
-	if (l)
-		return l;
+	if (!ns)
+		return NULL;
 
-	l = mowgli_list_create();
-	privatedata_set(mu, MYUSER_PRIVDATA_NAME, l);
+	if (out_namespace)
+		mowgli_strlcpy(out_namespace, ns->name, namespace_len);
 
-	return l;
+	return ns->project;
 }
 
 // TODO: move to projectns/mark?
-void show_marks(sourceinfo_t *si, struct projectns *p)
+// Shows count marks (all if 0) after skipping the first offset ones; returns how many were shown
+unsigned int show_marks(sourceinfo_t *si, struct projectns *p, unsigned int offset, unsigned int count)
 {
+	unsigned int shown = 0;
 	mowgli_node_t *n;
-	MOWGLI_ITER_FOREACH(n, p->marks.head)
+
+	for (n = mowgli_node_nth(&p->marks, offset); n && (!count || shown < count); n = n->next, shown++)
 	{
 		struct project_mark *m = n->data;
 
@@ -101,7 +129,7 @@ void show_marks(sourceinfo_t *si, struct projectns *p)
 		myuser_t *setter;
 		const char *setter_name;
 
-		if ((setter = myuser_find_uid(m->setter_id)) != NULL)
+		if ((setter = mark_setter(m)) != NULL)
 			setter_name = entity(setter)->name;
 		else
 			setter_name = m->setter_name;
@@ -130,4 +158,64 @@ void show_marks(sourceinfo_t *si, struct projectns *p)
 					);
 		}
 	}
+
+	return shown;
+}
+
+/* Copies the part of a match() pattern that every matching name has to start
+ * with. Besides wildcards, this stops at anything other than letters, digits
+ * and "#-./_", since the key indexes and match() may fold other characters
+ * differently depending on the casemapping in use.
+ */
+void glob_literal_prefix(const char * const pattern, char * const buf, const size_t bufsize)
+{
+	size_t i;
+
+	for (i = 0; pattern[i] && i + 1 < bufsize; i++)
+	{
+		const unsigned char c = pattern[i];
+
+		if (!isalnum(c) && !strchr("#-./_", c))
+			break;
+
+		buf[i] = c;
+	}
+
+	buf[i] = '\0';
+}
+
+// Parses "[LIMIT <n>] [NEXT <key>]" in either order; false if anything else is given
+bool parse_page_options(const int parc, char *parv[], struct page_options * const opts)
+{
+	opts->limit = 0;
+	opts->after = NULL;
+
+	for (int i = 0; i < parc; i += 2)
+	{
+		if (i + 1 >= parc)
+			return false;
+
+		if (strcasecmp(parv[i], "LIMIT") == 0)
+		{
+			char *end;
+
+			errno = 0;
+			unsigned long limit = strtoul(parv[i + 1], &end, 10);
+
+			if (errno || *end || !limit || limit > UINT_MAX)
+				return false;
+
+			opts->limit = limit;
+		}
+		else if (strcasecmp(parv[i], "NEXT") == 0)
+		{
+			opts->after = parv[i + 1];
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
 }
@@ -14,13 +14,8 @@ static void cmd_mark(sourceinfo_t *si, int parc, char *parv[]);
 
 static command_t ps_mark = { "MARK", N_("Sets internal notes on projects."), PRIV_PROJECT_ADMIN, 3, cmd_mark, { .path = "freenode/project_mark" } };
 
-static unsigned int get_last_mark_id(struct projectns *p)
-{
-	if (!p->marks.tail)
-		return 0;
-	else
-		return ((struct project_mark*)p->marks.tail->data)->number;
-}
+// marks shown by MARK LIST <offset> when no count is given
+#define MARK_LIST_PAGE 20
 
 static void cmd_mark(sourceinfo_t *si, int parc, char *parv[])
 {
@@ -48,7 +43,7 @@ static void cmd_mark(sourceinfo_t *si, int parc, char *parv[])
 	if (!op)
 	{
 		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, "MARK");
-		command_fail(si, fault_needmoreparams, _("Syntax: MARK <project> ADD|DEL|LIST <note or ID>"));
+		command_fail(si, fault_needmoreparams, _("Syntax: MARK <project> ADD <text> | DEL <ID> | LIST [<offset> [<count>]]"));
 		return;
 	}
 
@@ -79,31 +74,18 @@ static void cmd_mark(sourceinfo_t *si, int parc, char *parv[])
 			return;
 		}
 
-		bool found = false;
-		mowgli_node_t *n, *tn;
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, p->marks.head)
-		{
-			struct project_mark *mark = n->data;
-			if (mark->number == num)
-			{
-				free(mark->setter_id);
-				free(mark->setter_name);
-				free(mark->mark);
-				free(mark);
-
-				mowgli_node_delete(n, &p->marks);
-				mowgli_node_free(n);
-
-				found = true;
-				logcommand(si, CMDLOG_ADMIN, "MARK:DEL: \2%s\2 \2%lu\2", p->name, num);
-				command_success_nodata(si, _("The mark has been deleted."));
+		struct project_mark *mark = num <= UINT_MAX ? projectsvs->mark_find(p, num) : NULL;
 
-				break;
-			}
+		if (!mark)
+		{
+			command_fail(si, fault_nosuch_key, _("This mark does not exist."));
+			return;
 		}
 
-		if (!found)
-			command_fail(si, fault_nosuch_key, _("This mark does not exist."));
+		projectsvs->mark_destroy(p, mark);
+
+		logcommand(si, CMDLOG_ADMIN, "MARK:DEL: \2%s\2 \2%lu\2", p->name, num);
+		command_success_nodata(si, _("The mark has been deleted."));
 	}
 	else if (op == MARK_ADD)
 	{
@@ -114,30 +96,50 @@ static void cmd_mark(sourceinfo_t *si, int parc, char *parv[])
 			return;
 		}
 
-		struct project_mark *mark = smalloc(sizeof *mark);
-		mark->number = get_last_mark_id(p) + 1;
-		mark->time   = CURRTIME;
-		mark->mark   = sstrdup(param);
-		mark->setter_id   = sstrdup(entity(si->smu)->id);
-		mark->setter_name = sstrdup(entity(si->smu)->name);
-
-		mowgli_node_add(mark, mowgli_node_create(), &p->marks);
+		struct project_mark *mark = projectsvs->mark_new(p, 0, CURRTIME,
+		                                                 entity(si->smu)->id, entity(si->smu)->name, param);
 
 		command_success_nodata(si, _("\2%s\2 has been marked."), p->name);
 		logcommand(si, CMDLOG_ADMIN, "MARK:ADD: \2%s\2 \2%s\2", p->name, mark->mark);
 	}
 	else if (op == MARK_LIST)
 	{
+		unsigned long offset = 0, count = 0;
+		bool count_given = false;
+
 		if (param)
 		{
-			command_fail(si, fault_badparams, STR_INVALID_PARAMS, "MARK");
-			command_fail(si, fault_badparams, _("Syntax: MARK <project> LIST"));
-			return;
+			char *end;
+
+			errno = 0;
+			offset = strtoul(param, &end, 10);
+			count  = MARK_LIST_PAGE;
+
+			if (!errno && *end == ' ')
+			{
+				count = strtoul(end + 1, &end, 10);
+				count_given = true;
+			}
+
+			if (errno || *end || end == param || !count || offset > UINT_MAX || count > UINT_MAX)
+			{
+				command_fail(si, fault_badparams, STR_INVALID_PARAMS, "MARK");
+				command_fail(si, fault_badparams, _("Syntax: MARK <project> LIST [<offset> [<count>]]"));
+				return;
+			}
 		}
 
 		command_success_nodata(si, _("Marks for project \2%s\2:"), p->name);
-		projectsvs->show_marks(si, p);
-		command_success_nodata(si, _("End of list."));
+		unsigned int shown = projectsvs->show_marks(si, p, offset, count);
+
+		if (count && offset + shown < p->marks.count && count_given)
+			command_success_nodata(si, _("Shown %u of %zu marks; use \2MARK %s LIST %lu %lu\2 to see more."),
+			                       shown, p->marks.count, p->name, offset + shown, count);
+		else if (count && offset + shown < p->marks.count)
+			command_success_nodata(si, _("Shown %u of %zu marks; use \2MARK %s LIST %lu\2 to see more."),
+			                       shown, p->marks.count, p->name, offset + shown);
+		else
+			command_success_nodata(si, _("End of list."));
 
 		logcommand(si, CMDLOG_GET, "MARK:LIST: \2%s\2", p->name);
 	}
@@ -32,6 +32,28 @@ static inline void projectns_main_symbol_impl(module_t *m)
 	MODULE_TRY_REQUEST_SYMBOL(m, projectsvs, MAIN_MODULE, "projectsvs");
 }
 
+// Adds the time since start to a hook's latency histogram
+static inline void hook_latency_record(const enum projectns_hook hook, const struct timespec * const start)
+{
+	struct latency_histogram * const h = &projectsvs->hook_latency[hook];
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	const int64_t elapsed = (int64_t)(end.tv_sec - start->tv_sec) * 1000000000 + (end.tv_nsec - start->tv_nsec);
+	const uint64_t ns = elapsed > 0 ? (uint64_t)elapsed : 0;
+
+	unsigned int bucket = 0;
+	for (uint64_t v = ns >> 1; v && bucket < LATENCY_BUCKETS - 1; v >>= 1)
+		bucket++;
+
+	h->calls++;
+	h->total_ns += ns;
+	h->buckets[bucket]++;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+}
+
 // needed because MODULE_TRY_REQUEST_SYMBOL will "return" on our behalf
 static inline bool use_projectns_main_symbols(module_t *m)
 {
@@ -18,18 +18,86 @@
 // Arbitrary number that should avoid truncation even with various protocol overhead
 #define PROJECTNAMELEN CHANNELLEN
 
-#define PROJECTNS_ABIREV 10U
+// Exports are confined to files with this suffix in the data directory
+#define PROJECT_EXPORT_SUFFIX ".ndjson"
+
+#define PROJECTNS_ABIREV 30U
 
 #define PROJECTNS_MINVER_CLOAKNS 4U
 #define PROJECTNS_MINVER_CREATION_MD 9U
 #define PROJECTNS_MINVER_CONTACT_OBJECT 10U
+#define PROJECTNS_MINVER_JOURNAL 13U
+#define PROJECTNS_MINVER_ADOPT 14U
+#define PROJECTNS_MINVER_POOLS 15U
+#define PROJECTNS_MINVER_NAMESPACE_OBJECT 16U
+#define PROJECTNS_MINVER_RENDER 18U
+#define PROJECTNS_MINVER_MARK_INDEX 19U
+#define PROJECTNS_MINVER_KEY_INDEX 20U
+#define PROJECTNS_MINVER_AUDIT_SETS 23U
+#define PROJECTNS_MINVER_ACCOUNT_INDEX 26U
+#define PROJECTNS_MINVER_HOOK_LATENCY 28U
+
+// A match() pattern prepared for repeated use, see glob_compile()
+struct compiled_glob;
 
 struct project_mark {
+	mowgli_node_t node;
 	time_t time;
 	unsigned int number;
 	char *mark;
 	char *setter_id;
 	char *setter_name;
+	myuser_t *setter;           // cached lookup of setter_id, see mark_setter()
+	unsigned int setter_epoch;
+};
+
+// Cached list text for the various INFO outputs, see project_render()
+enum project_render_view {
+	PROJECT_RENDER_USERINFO,       // namespaces, as shown to the contact
+	PROJECT_RENDER_USERINFO_PRIV,  // the same, with the MARKED flag
+	PROJECT_RENDER_CHANINFO,       // public contacts
+	PROJECT_RENDER_CHANINFO_PRIV,  // public and unlisted contacts, secondary ones annotated
+	PROJECT_RENDER_INFO,           // everything listed by PROJECTSERV INFO
+	PROJECT_RENDER_VIEWS,
+};
+
+// sections of PROJECT_RENDER_CHANINFO(_PRIV)
+#define PROJECT_RENDER_CHANINFO_PUBLIC   0
+#define PROJECT_RENDER_CHANINFO_UNLISTED 1
+
+// sections of PROJECT_RENDER_INFO
+#define PROJECT_RENDER_INFO_CHANNELS          0
+#define PROJECT_RENDER_INFO_CLOAKS            1
+#define PROJECT_RENDER_INFO_GROUP_PUBLIC      2
+#define PROJECT_RENDER_INFO_GROUP_PRIVATE     3
+#define PROJECT_RENDER_INFO_SECONDARY_PUBLIC  4
+#define PROJECT_RENDER_INFO_SECONDARY_PRIVATE 5
+
+#define PROJECT_RENDER_MAX_SECTIONS 6
+
+/* Cached chunks are shared by all viewers, so translatable annotations are
+ * stored as these control characters (which no account or namespace name can
+ * contain) and spelled out in the viewer's language when sending.
+ */
+#define PROJECT_RENDER_MARKED    '\001'  // starts the first USERINFO_PRIV chunk: "MARKED"
+#define PROJECT_RENDER_SECONDARY '\006'  // follows a secondary contact's name: " (secondary)"
+
+struct project_render_section {
+	unsigned int items;
+	unsigned int nchunks;
+	char **chunks;  // one output line each
+};
+
+struct project_render {
+	unsigned int generation;
+	struct project_render_section sections[PROJECT_RENDER_MAX_SECTIONS];
+};
+
+// Incomplete registrations reported by AUDIT, kept up to date by project_touch()
+enum project_audit_set {
+	PROJECT_AUDIT_NO_CHANNELS,
+	PROJECT_AUDIT_NO_CONTACTS,
+	PROJECT_AUDIT_SETS,
 };
 
 struct projectns {
@@ -42,6 +110,20 @@ struct projectns {
 	mowgli_list_t cloak_ns;
 	time_t creation_time;
 	stringref creator;
+	unsigned int generation;  // bumped by project_touch() on every change
+	struct project_render *render[PROJECT_RENDER_VIEWS];
+	unsigned int last_mark_id;  // highest mark ID ever assigned; IDs are not reused
+	unsigned int audit_sets;  // bit (1U << set) for each of projectsvs.audit_sets we are in
+	mowgli_node_t audit_n[PROJECT_AUDIT_SETS];
+};
+
+/* Value type of channel_namespaces and cloak_namespaces. The node is in the
+ * owning project's channel_ns or cloak_ns list, with the name as its data.
+ */
+struct project_namespace {
+	mowgli_node_t node;
+	struct projectns *project;
+	char name[];  // as registered, while the tree key is case-normalized
 };
 
 struct project_contact {
@@ -52,29 +134,112 @@ struct project_contact {
 	bool secondary;
 };
 
+/* Trailing "[LIMIT <n>] [NEXT <key>]" of the listing commands. A listing cut
+ * short by its limit tells the user the key to continue after.
+ */
+struct page_options {
+	unsigned int limit;  // 0 for no limit
+	const char *after;   // resume after this key, or NULL
+};
+
+// The hooks projectns/hooks adds to ChanServ and NickServ, timed on every call
+enum projectns_hook {
+	PROJECTNS_HOOK_TRY_REGISTER,
+	PROJECTNS_HOOK_DID_REGISTER,
+	PROJECTNS_HOOK_CHANINFO,
+	PROJECTNS_HOOK_USERINFO,
+	PROJECTNS_HOOKS
+};
+
+/* Bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds, except that the
+ * first also takes anything faster and the last anything slower.
+ */
+#define LATENCY_BUCKETS 36
+
+struct latency_histogram {
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[LATENCY_BUCKETS];
+};
+
 struct projectsvs_conf {
 	char *namespace_separators;
 	bool default_open_registration;
+	bool journal;
+	unsigned int journal_compact;
 };
 
 struct projectsvs {
 	service_t *me;
 	mowgli_patricia_t *projects;
-	mowgli_patricia_t *projects_by_channelns;
-	mowgli_patricia_t *projects_by_cloakns;
+	mowgli_patricia_t *channel_namespaces;
+	mowgli_patricia_t *cloak_namespaces;
+	mowgli_list_t audit_sets[PROJECT_AUDIT_SETS];
+	struct latency_histogram hook_latency[PROJECTNS_HOOKS];
 	struct projectsvs_conf config;
 
 	struct projectns *(*project_new)(const char *name);
 	struct projectns *(*project_find)(const char *name);
 	void (*project_destroy)(struct projectns *p);
+	void (*project_touch)(struct projectns * const p);
+	void (*project_rename)(struct projectns * const p, const char * const newname);
+	const struct project_render *(*project_render)(struct projectns * const p, const enum project_render_view view);
+	void (*project_set_creation)(struct projectns * const p, const time_t time, const char * const creator);
+	unsigned int (*projects_by_creation)(const time_t after, const time_t before, const char * const creator,
+	                                     const time_t from_time, const char * const from_name,
+	                                     int (*cb)(struct projectns *p, void *privdata), void *privdata);
 
 	struct project_contact *(*contact_new)(struct projectns * const p, myuser_t * const mu);
 	bool (*contact_destroy)(struct projectns * const p, myuser_t * const mu);
+	struct project_contact *(*contact_find)(const struct projectns * const p, const myuser_t * const mu);
+	bool (*is_contact)(const struct projectns * const p, const myuser_t * const mu);
+
+	struct project_namespace *(*channelns_find)(const char * const ns);
+	struct project_namespace *(*cloakns_find)(const char * const ns);
+	bool (*channelns_add)(struct projectns * const p, const char * const ns);
+	bool (*channelns_del)(struct projectns * const p, const char * const ns);
+	bool (*cloakns_add)(struct projectns * const p, const char * const ns);
+	bool (*cloakns_del)(struct projectns * const p, const char * const ns);
+
+	struct project_mark *(*mark_new)(struct projectns * const p, const unsigned int number, const time_t time,
+	                                 const char * const setter_id, const char * const setter_name, const char * const text);
+	void (*mark_destroy)(struct projectns * const p, struct project_mark * const mark);
+	struct project_mark *(*mark_find)(const struct projectns * const p, const unsigned int number);
 
-	void (*show_marks)(sourceinfo_t *si, struct projectns *p);
+	unsigned int (*show_marks)(sourceinfo_t *si, struct projectns *p, unsigned int offset, unsigned int count);
 	bool (*is_valid_project_name)(const char *name);
-	mowgli_list_t *(*myuser_get_projects)(myuser_t *mt);
-	struct projectns *(*channame_get_project)(const char *name, char **out_namespace);
+	mowgli_list_t *(*myuser_get_projects)(myuser_t *mt);  // struct project_contact list; read-only
+	struct projectns *(*channame_get_project)(const char *name, char *out_namespace, size_t namespace_len);
+	void (*show_pool_stats)(sourceinfo_t *si);
+	void (*show_registry_stats)(sourceinfo_t *si);
+	unsigned int (*cloakns_foreach_online)(const struct project_namespace * const ns, void (*cb)(user_t *u, void *privdata), void *privdata);
+
+	/* Ordered scans over the keys of projects, channel_namespaces and cloak_namespaces
+	 * starting with a prefix (see glob_literal_prefix), optionally resuming after a
+	 * given key; cb returns nonzero to stop early.
+	 */
+	unsigned int (*projects_foreach_prefix)(const char * const prefix, const char * const after,
+	                                        int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+	unsigned int (*channelns_foreach_prefix)(const char * const prefix, const char * const after,
+	                                         int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+	unsigned int (*cloakns_foreach_prefix)(const char * const prefix, const char * const after,
+	                                       int (*cb)(const char *key, void *data, void *privdata), void *privdata);
+	void (*glob_literal_prefix)(const char * const pattern, char * const buf, const size_t bufsize);
+
+	struct compiled_glob *(*glob_compile)(const char * const pattern);
+	bool (*glob_match)(const struct compiled_glob * const g, const char * const name);
+	void (*glob_free)(struct compiled_glob * const g);
+	bool (*parse_page_options)(const int parc, char *parv[], struct page_options * const opts);
+
+	/* Streams the registry as JSON to a file in the data directory, in the background;
+	 * the name must end in PROJECT_EXPORT_SUFFIX
+	 */
+	bool (*export_start)(const char * const filename, const char * const requester);
+	bool (*export_running)(void);
+
+	// Screens a file name given to a command for the data directory, see util.c
+	bool (*is_valid_data_file_name)(const char * const name, const char * const suffix);
 };
 
 #endif
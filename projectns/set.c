@@ -113,6 +113,7 @@ static void set_openreg(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	p->any_may_register = new_openreg;
+	projectsvs->project_touch(p);
 
 	logcommand(si, CMDLOG_ADMIN, "PROJECT:SET:OPENREG:%s: \2%s\2", onoff_str, name);
 	if (new_openreg)
@@ -137,6 +138,7 @@ static void set_reginfo(sourceinfo_t *si, int parc, char *parv[])
 	{
 		free(p->reginfo);
 		p->reginfo = sstrdup(info);
+		projectsvs->project_touch(p);
 		logcommand(si, CMDLOG_ADMIN, "PROJECT:SET:REGINFO: \2%s\2 to \2%s\2", p->name, info);
 		command_success_nodata(si, _("The public namespace information for project \2%s\2 has been set to \2%s\2."), p->name, info);
 	}
@@ -144,6 +146,7 @@ static void set_reginfo(sourceinfo_t *si, int parc, char *parv[])
 	{
 		free(p->reginfo);
 		p->reginfo = NULL;
+		projectsvs->project_touch(p);
 		logcommand(si, CMDLOG_ADMIN, "PROJECT:SET:REGINFO:CLEAR: \2%s\2", p->name);
 		command_success_nodata(si, _("The public namespace information for project \2%s\2 has been cleared."), p->name);
 	}
@@ -188,16 +191,10 @@ static void set_name(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	p->name = sstrdup(newname);
-
-	// must be in this order or this will break if only casing is changed
-	mowgli_patricia_delete(projectsvs->projects, oldname);
-	mowgli_patricia_add(projectsvs->projects, newname, p);
-
 	logcommand(si, CMDLOG_ADMIN, "PROJECT:SET:NAME: \2%s\2 to \2%s\2", oldname, newname);
 	command_success_nodata(si, _("The \2%s\2 project has been renamed to \2%s\2."), oldname, newname);
 
-	free(oldname);
+	projectsvs->project_rename(p, newname);
 }
 
 static void mod_init(module_t *const restrict m)
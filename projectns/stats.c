@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2018-2019 Janik Kleinhoff
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Services awareness of group registrations
+ * Command to show internal statistics
+ */
+
+#include "fn-compat.h"
+#include "atheme.h"
+#include "projectns.h"
+
+static void cmd_stats(sourceinfo_t *si, int parc, char *parv[]);
+
+static command_t ps_stats = {
+	.name       = "STATS",
+	.desc       = N_("Shows memory usage of the project registry"),
+	.access     = PRIV_PROJECT_AUSPEX,
+	.maxparc    = 0,
+	.cmd        = cmd_stats,
+	.help       = { .path = "freenode/project_stats" },
+};
+
+static void cmd_stats(sourceinfo_t *si, int parc, char *parv[])
+{
+	projectsvs->show_registry_stats(si);
+	command_success_nodata(si, _("Object pools:"));
+	projectsvs->show_pool_stats(si);
+	command_success_nodata(si, _("*** \2End of statistics\2 ***"));
+
+	logcommand(si, CMDLOG_ADMIN, "PROJECT:STATS");
+}
+
+static void mod_init(module_t *const restrict m)
+{
+	if (!use_projectns_main_symbols(m))
+		return;
+	service_named_bind_command("projectserv", &ps_stats);
+}
+
+static void mod_deinit(const module_unload_intent_t unused)
+{
+	service_named_unbind_command("projectserv", &ps_stats);
+}
+
+DECLARE_MODULE_V1
+(
+	"freenode/projectns/stats", MODULE_UNLOAD_CAPABILITY_OK, mod_init, mod_deinit,
+	"", "freenode <http://www.freenode.net>"
+);